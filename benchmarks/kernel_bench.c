@@ -0,0 +1,573 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__linux__)
+	#include <sched.h>
+#endif
+
+#if defined(HAVE_LINUX_PERF_EVENT_H)
+	#include <unistd.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+#endif
+
+#include "argparser.h"
+#include "reverse_memcpy.h"
+#include "stringu.h"
+
+/*
+Microbenchmark for the reverse_memcpy() kernels.
+
+For every kernel compiled into the binary that the current CPU can run, this sweeps
+the buffer size (powers of two), the source and destination misalignment, and the
+overlap between both buffers, then reports the throughput and the cost per byte.
+
+Each measurement is repeated several times and the best and median runs are reported.
+Pin the process to a single CPU (--cpu) and keep the machine otherwise idle to get
+numbers that are reproducible between runs.
+*/
+
+static const char BENCH_USAGE[] =
+	"usage: revf_kernel_bench [--min-size=SIZE] [--max-size=SIZE] [--kernel=NAME] [--repeat=N] [--cpu=N] [--counters] [--csv]\n"
+	"\n"
+	"Measure the throughput of every reverse_memcpy() kernel.\n"
+	"\n"
+	"options:\n"
+	"  --min-size=SIZE  Smallest buffer size to test (default: 16).\n"
+	"  --max-size=SIZE  Largest buffer size to test (default: 64M).\n"
+	"  --kernel=NAME    Only test the kernel with this name (\"auto\" is the dispatcher).\n"
+	"  --repeat=N       Number of timed runs per measurement (default: 5).\n"
+	"  --cpu=N          Pin the benchmark to this CPU (Linux only).\n"
+	"  --counters       Read hardware counters through perf_event_open(), if available.\n"
+	"  --csv            Print comma separated values instead of a table.\n";
+
+// Each timed run copies at least this many bytes, so that small sizes are not dominated by timer overhead
+#define BENCH_BYTES_PER_RUN (64 * 1024 * 1024)
+
+#define BENCH_MAX_ALIGNMENT 64
+
+// Upper bound for --repeat; each run keeps one timing sample
+#define BENCH_MAX_REPEAT 1000
+
+enum BenchOverlap {
+	BENCH_OVERLAP_NONE,
+	BENCH_OVERLAP_FULL
+};
+
+struct BenchAlignment {
+	size_t source;
+	size_t destination;
+};
+
+static const struct BenchAlignment alignments[] = {
+	{0, 0},
+	{1, 0},
+	{0, 1},
+	{7, 13},
+	{32, 0}
+};
+
+struct BenchCounters {
+	int enabled;
+	int fds[4];
+	uint64_t values[4];
+};
+
+static const char* const counter_names[] = {
+	"cycles",
+	"instructions",
+	"llc-refs",
+	"llc-misses"
+};
+
+struct BenchResult {
+	double best_seconds;
+	double median_seconds;
+	uint64_t ticks;
+	uint64_t counters[4];
+	int has_counters;
+};
+
+static double now(void) {
+	
+	struct timespec ts = {0};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+	
+}
+
+static uint64_t ticks(void) {
+	
+	#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+	#else
+		return 0;
+	#endif
+	
+}
+
+static int compare_doubles(const void* const a, const void* const b) {
+	
+	const double x = *(const double*) a;
+	const double y = *(const double*) b;
+	
+	return (x > y) - (x < y);
+	
+}
+
+static size_t next_size(const size_t size, const size_t max_size) {
+	/*
+	Returns the buffer size to test after size, or (0) once max_size is reached.
+	*/
+	
+	// Doubling past max_size could wrap around
+	if (size > max_size / 2) {
+		return 0;
+	}
+	
+	return size * 2;
+	
+}
+
+#if defined(HAVE_LINUX_PERF_EVENT_H)
+	static int perf_open(const uint32_t type, const uint64_t config, const int group) {
+		
+		struct perf_event_attr attr = {0};
+		
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = (group == -1);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		
+		return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+		
+	}
+#endif
+
+static int counters_init(struct BenchCounters* const counters) {
+	/*
+	Opens the hardware counters as a single group, so that they are scheduled together.
+	
+	Returns (0) on success, (-1) if perf events are not available.
+	*/
+	
+	#if defined(HAVE_LINUX_PERF_EVENT_H)
+		const uint64_t configs[] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_REFERENCES,
+			PERF_COUNT_HW_CACHE_MISSES
+		};
+		
+		for (size_t index = 0; index < 4; index++) {
+			const int group = (index == 0) ? -1 : counters->fds[0];
+			
+			counters->fds[index] = perf_open(PERF_TYPE_HARDWARE, configs[index], group);
+			
+			if (counters->fds[index] == -1) {
+				for (size_t previous = 0; previous < index; previous++) {
+					close(counters->fds[previous]);
+				}
+				
+				return -1;
+			}
+		}
+		
+		counters->enabled = 1;
+		
+		return 0;
+	#else
+		(void) counters;
+		return -1;
+	#endif
+	
+}
+
+static void counters_start(struct BenchCounters* const counters) {
+	
+	#if defined(HAVE_LINUX_PERF_EVENT_H)
+		if (!counters->enabled) {
+			return;
+		}
+		
+		ioctl(counters->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(counters->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	#else
+		(void) counters;
+	#endif
+	
+}
+
+static void counters_stop(struct BenchCounters* const counters) {
+	
+	#if defined(HAVE_LINUX_PERF_EVENT_H)
+		if (!counters->enabled) {
+			return;
+		}
+		
+		ioctl(counters->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		
+		for (size_t index = 0; index < 4; index++) {
+			if (read(counters->fds[index], &counters->values[index], sizeof(*counters->values)) != sizeof(*counters->values)) {
+				counters->values[index] = 0;
+			}
+		}
+	#else
+		(void) counters;
+	#endif
+	
+}
+
+static void run(
+	const struct ReverseMemcpyKernel* const kernel,
+	char* const source,
+	char* const destination,
+	const size_t size,
+	const enum BenchOverlap overlap,
+	const size_t repeat,
+	double* const seconds,
+	struct BenchCounters* const counters,
+	struct BenchResult* const result
+) {
+	
+	const size_t iterations = (size > BENCH_BYTES_PER_RUN) ? 1 : BENCH_BYTES_PER_RUN / size;
+	
+	memset(result, 0, sizeof(*result));
+	
+	// Warm up caches, TLBs and the branch predictor
+	if (overlap == BENCH_OVERLAP_FULL) {
+		reverse_inplace(source, size);
+	} else {
+		kernel->function(destination, source, size);
+	}
+	
+	for (size_t index = 0; index < repeat; index++) {
+		counters_start(counters);
+		
+		const uint64_t start_ticks = ticks();
+		const double start = now();
+		
+		if (overlap == BENCH_OVERLAP_FULL) {
+			for (size_t iteration = 0; iteration < iterations; iteration++) {
+				reverse_inplace(source, size);
+			}
+		} else {
+			for (size_t iteration = 0; iteration < iterations; iteration++) {
+				kernel->function(destination, source, size);
+			}
+		}
+		
+		const double elapsed = (now() - start) / (double) iterations;
+		const uint64_t elapsed_ticks = (ticks() - start_ticks) / iterations;
+		
+		counters_stop(counters);
+		
+		seconds[index] = elapsed;
+		
+		if (index == 0 || elapsed < result->best_seconds) {
+			result->best_seconds = elapsed;
+			result->ticks = elapsed_ticks;
+			
+			if (counters->enabled) {
+				for (size_t counter = 0; counter < 4; counter++) {
+					result->counters[counter] = counters->values[counter] / iterations;
+				}
+				
+				result->has_counters = 1;
+			}
+		}
+	}
+	
+	qsort(seconds, repeat, sizeof(*seconds), compare_doubles);
+	
+	result->median_seconds = seconds[repeat / 2];
+	
+}
+
+static void print_header(const int csv, const int has_counters) {
+	
+	if (csv) {
+		printf("kernel,size,source_alignment,destination_alignment,overlap,best_gbps,median_gbps,cycles_per_byte");
+		
+		if (has_counters) {
+			for (size_t index = 0; index < 4; index++) {
+				printf(",%s", counter_names[index]);
+			}
+		}
+		
+		printf("\n");
+		
+		return;
+	}
+	
+	printf("%-14s %12s %6s %6s %7s %10s %10s %10s", "kernel", "size", "salign", "dalign", "overlap", "best GB/s", "med GB/s", "cycles/B");
+	
+	if (has_counters) {
+		printf(" %8s %12s", "IPC", "llc-miss/KB");
+	}
+	
+	printf("\n");
+	
+}
+
+static void print_result(
+	const int csv,
+	const char* const name,
+	const size_t size,
+	const struct BenchAlignment* const alignment,
+	const enum BenchOverlap overlap,
+	const struct BenchResult* const result
+) {
+	
+	const double best = (double) size / result->best_seconds / 1e9;
+	const double median = (double) size / result->median_seconds / 1e9;
+	
+	// Prefer the real core cycle count over the TSC, which ticks at a fixed reference frequency
+	double cycles = -1;
+	
+	if (result->has_counters && result->counters[0] != 0) {
+		cycles = (double) result->counters[0] / (double) size;
+	} else if (result->ticks != 0) {
+		cycles = (double) result->ticks / (double) size;
+	}
+	
+	const char* const overlap_name = (overlap == BENCH_OVERLAP_FULL) ? "full" : "none";
+	
+	if (csv) {
+		printf("%s,%zu,%zu,%zu,%s,%.3f,%.3f,%.4f", name, size, alignment->source, alignment->destination, overlap_name, best, median, cycles);
+		
+		if (result->has_counters) {
+			for (size_t index = 0; index < 4; index++) {
+				printf(",%llu", (unsigned long long) result->counters[index]);
+			}
+		}
+		
+		printf("\n");
+	} else {
+		printf("%-14s %12zu %6zu %6zu %7s %10.3f %10.3f", name, size, alignment->source, alignment->destination, overlap_name, best, median);
+		
+		if (cycles < 0) {
+			printf(" %10s", "n/a");
+		} else {
+			printf(" %10.4f", cycles);
+		}
+		
+		if (result->has_counters) {
+			const double ipc = (result->counters[0] == 0) ? 0 : (double) result->counters[1] / (double) result->counters[0];
+			const double misses = (double) result->counters[3] * 1024.0 / (double) size;
+			
+			printf(" %8.2f %12.3f", ipc, misses);
+		}
+		
+		printf("\n");
+	}
+	
+	fflush(stdout);
+	
+}
+
+int main(int argc, char* argv[]) {
+	
+	size_t min_size = 16;
+	size_t max_size = 64 * 1024 * 1024;
+	size_t repeat = 5;
+	
+	char* kernel_name = NULL;
+	
+	int use_counters = 0;
+	int csv = 0;
+	
+	struct ArgumentParser argparser = {0};
+	argparser_init(&argparser, argc, argv);
+	
+	while (1) {
+		const struct Argument* const argument = argparser_next(&argparser);
+		
+		if (argument == NULL) {
+			break;
+		}
+		
+		if (strcmp(argument->key, "min-size") == 0 || strcmp(argument->key, "max-size") == 0) {
+			size_t* const size = (strcmp(argument->key, "min-size") == 0) ? &min_size : &max_size;
+			uint64_t value = 0;
+			
+			// Both buffers are allocated with some room for misalignment on top of the largest size
+			if (argument->value == NULL || parse_size(argument->value, &value) == -1 || value == 0 || value > SIZE_MAX - BENCH_MAX_ALIGNMENT) {
+				fprintf(stderr, "fatal error: invalid value for --%s\n", argument->key);
+				return EXIT_FAILURE;
+			}
+			
+			*size = (size_t) value;
+		} else if (strcmp(argument->key, "repeat") == 0) {
+			char* end = NULL;
+			const unsigned long int number = (argument->value == NULL) ? 0 : strtoul(argument->value, &end, 10);
+			
+			if (argument->value == NULL || *argument->value < '0' || *argument->value > '9' || *end != '\0' || number < 1 || number > BENCH_MAX_REPEAT) {
+				fprintf(stderr, "fatal error: invalid value for --repeat (expected 1 to %i)\n", BENCH_MAX_REPEAT);
+				return EXIT_FAILURE;
+			}
+			
+			repeat = (size_t) number;
+		} else if (strcmp(argument->key, "kernel") == 0) {
+			if (argument->value == NULL) {
+				fprintf(stderr, "fatal error: missing value for --kernel\n");
+				return EXIT_FAILURE;
+			}
+			
+			free(kernel_name);
+			kernel_name = strdup(argument->value);
+			
+			if (kernel_name == NULL) {
+				fprintf(stderr, "fatal error: could not allocate memory\n");
+				return EXIT_FAILURE;
+			}
+		} else if (strcmp(argument->key, "cpu") == 0) {
+			#if defined(__linux__)
+				char* end = NULL;
+				const unsigned long int cpu = (argument->value == NULL) ? 0 : strtoul(argument->value, &end, 10);
+				
+				if (argument->value == NULL || *argument->value < '0' || *argument->value > '9' || *end != '\0' || cpu >= CPU_SETSIZE) {
+					fprintf(stderr, "fatal error: invalid value for --cpu\n");
+					return EXIT_FAILURE;
+				}
+				
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				CPU_SET((int) cpu, &set);
+				
+				if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+					perror("fatal error: could not pin to CPU");
+					return EXIT_FAILURE;
+				}
+			#else
+				fprintf(stderr, "warning: --cpu is not supported on this platform\n");
+			#endif
+		} else if (strcmp(argument->key, "counters") == 0) {
+			use_counters = 1;
+		} else if (strcmp(argument->key, "csv") == 0) {
+			csv = 1;
+		} else if (strcmp(argument->key, "h") == 0 || strcmp(argument->key, "help") == 0) {
+			printf("%s", BENCH_USAGE);
+			return EXIT_SUCCESS;
+		} else {
+			fprintf(stderr, "fatal error: unknown option '%s'\n\n%s", argument->key, BENCH_USAGE);
+			return EXIT_FAILURE;
+		}
+	}
+	
+	if (min_size > max_size) {
+		fprintf(stderr, "fatal error: --min-size is larger than --max-size\n");
+		
+		free(kernel_name);
+		
+		return EXIT_FAILURE;
+	}
+	
+	struct BenchCounters counters = {0};
+	
+	if (use_counters && counters_init(&counters) == -1) {
+		fprintf(stderr, "warning: hardware counters are not available, continuing without them\n");
+	}
+	
+	size_t count = 0;
+	const struct ReverseMemcpyKernel* const kernels = reverse_memcpy_kernels(&count);
+	
+	// The dispatcher, as used by revf itself
+	const struct ReverseMemcpyKernel dispatcher = {"auto", reverse_memcpy, 0, 1};
+	
+	char* const source = malloc(max_size + BENCH_MAX_ALIGNMENT);
+	char* const destination = malloc(max_size + BENCH_MAX_ALIGNMENT);
+	double* const seconds = malloc(repeat * sizeof(*seconds));
+	
+	if (source == NULL || destination == NULL || seconds == NULL) {
+		fprintf(stderr, "fatal error: could not allocate 2 x %zu bytes\n", max_size + BENCH_MAX_ALIGNMENT);
+		
+		free(source);
+		free(destination);
+		free(seconds);
+		free(kernel_name);
+		
+		return EXIT_FAILURE;
+	}
+	
+	// Touch every page upfront so that page faults are not measured
+	for (size_t index = 0; index < max_size + BENCH_MAX_ALIGNMENT; index++) {
+		source[index] = (char) (index * 31 + 7);
+	}
+	
+	memset(destination, 0, max_size + BENCH_MAX_ALIGNMENT);
+	
+	fprintf(stderr, "selected kernel: %s\n", reverse_memcpy_selected()->name);
+	
+	print_header(csv, counters.enabled);
+	
+	for (size_t index = 0; index <= count; index++) {
+		const struct ReverseMemcpyKernel* const kernel = (index == count) ? &dispatcher : &kernels[index];
+		
+		if (!kernel->available) {
+			fprintf(stderr, "skipping kernel %s: not supported by this CPU\n", kernel->name);
+			continue;
+		}
+		
+		if (kernel_name != NULL && strcmp(kernel_name, kernel->name) != 0) {
+			continue;
+		}
+		
+		if (!reverse_memcpy_verify(kernel->function)) {
+			fprintf(stderr, "skipping kernel %s: results do not match the scalar kernel\n", kernel->name);
+			continue;
+		}
+		
+		for (size_t size = min_size; size != 0; size = next_size(size, max_size)) {
+			for (size_t item = 0; item < sizeof(alignments) / sizeof(*alignments); item++) {
+				const struct BenchAlignment* const alignment = &alignments[item];
+				
+				struct BenchResult result = {0};
+				
+				run(kernel, source + alignment->source, destination + alignment->destination, size, BENCH_OVERLAP_NONE, repeat, seconds, &counters, &result);
+				print_result(csv, kernel->name, size, alignment, BENCH_OVERLAP_NONE, &result);
+			}
+		}
+	}
+	
+	/*
+	reverse_memcpy() requires disjoint buffers; the only overlapping case revf has is a
+	buffer reversed onto itself, which goes through reverse_inplace() and whatever kernel
+	the dispatcher picked.
+	*/
+	if (kernel_name == NULL || strcmp(kernel_name, dispatcher.name) == 0) {
+		for (size_t size = min_size; size != 0; size = next_size(size, max_size)) {
+			for (size_t offset = 0; offset < 2; offset++) {
+				const struct BenchAlignment alignment = {offset, offset};
+				
+				struct BenchResult result = {0};
+				
+				run(&dispatcher, source + offset, source + offset, size, BENCH_OVERLAP_FULL, repeat, seconds, &counters, &result);
+				print_result(csv, "inplace", size, &alignment, BENCH_OVERLAP_FULL, &result);
+			}
+		}
+	}
+	
+	free(source);
+	free(destination);
+	free(seconds);
+	free(kernel_name);
+	
+	return EXIT_SUCCESS;
+	
+}
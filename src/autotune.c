@@ -0,0 +1,598 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <time.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+#if defined(__linux__)
+	#include <sys/sysmacros.h>
+#endif
+
+#include "autotune.h"
+#include "filesystem.h"
+#include "fstream.h"
+#include "reverse_memcpy.h"
+#include "stringu.h"
+#include "tempfile.h"
+
+// Chunk sizes tried for the stream engine
+static const size_t AUTOTUNE_CHUNK_SIZES[] = {
+	64 * 1024,
+	256 * 1024,
+	1024 * 1024,
+	4 * 1024 * 1024
+};
+
+#define AUTOTUNE_CHUNK_SIZES_COUNT (sizeof(AUTOTUNE_CHUNK_SIZES) / sizeof(*AUTOTUNE_CHUNK_SIZES))
+
+// Amount of data read by each candidate; every candidate gets a region of the file of its own
+#define AUTOTUNE_SAMPLE_SIZE (AUTOTUNE_MIN_FILE_SIZE / (AUTOTUNE_CHUNK_SIZES_COUNT + 1))
+
+// Largest profile file accepted; a line takes less than 64 bytes besides the identity of its device
+#define AUTOTUNE_MAX_FILE_SIZE (64 * 1024)
+
+#if !defined(_WIN32)
+
+static uint64_t now(void) {
+	
+	struct timespec ts = {0};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+	
+}
+
+static void evict(const int fd, const off_t offset, const off_t size) {
+	/*
+	Drops a region of the file from the page cache, so that it is measured as read
+	from the device rather than from memory. This is only a hint, and dirty pages
+	are kept.
+	*/
+	
+	#if defined(POSIX_FADV_DONTNEED)
+		posix_fadvise(fd, offset, size, POSIX_FADV_DONTNEED);
+	#else
+		(void) fd;
+		(void) offset;
+		(void) size;
+	#endif
+	
+}
+
+static int64_t measure_stream(const int fd, char* const buffer, const size_t chunk_size, const off_t start) {
+	/*
+	Reads the sample starting at start backwards in chunks of the given size, reversing
+	each one, as the stream engine would.
+	
+	Returns the time taken in nanoseconds, or (-1) on error.
+	*/
+	
+	char* const reverse_buffer = buffer + AUTOTUNE_SAMPLE_SIZE;
+	
+	evict(fd, start, AUTOTUNE_SAMPLE_SIZE);
+	
+	const uint64_t begin = now();
+	
+	off_t end = start + AUTOTUNE_SAMPLE_SIZE;
+	
+	while (end > start) {
+		const off_t offset = end - (off_t) chunk_size;
+		
+		size_t done = 0;
+		
+		while (done < chunk_size) {
+			const ssize_t rsize = pread(fd, buffer + done, chunk_size - done, offset + (off_t) done);
+			
+			if (rsize == -1 && errno == EINTR) {
+				continue;
+			}
+			
+			if (rsize <= 0) {
+				return -1;
+			}
+			
+			done += (size_t) rsize;
+		}
+		
+		reverse_memcpy(reverse_buffer, buffer, chunk_size);
+		
+		end = offset;
+	}
+	
+	return (int64_t) (now() - begin);
+	
+}
+
+static int64_t measure_mmap(const int fd, char* const buffer, const off_t start) {
+	/*
+	Reverses the sample starting at start out of a memory mapping, as the mmap engine
+	would.
+	
+	Returns the time taken in nanoseconds, or (-1) on error.
+	*/
+	
+	evict(fd, start, AUTOTUNE_SAMPLE_SIZE);
+	
+	const uint64_t begin = now();
+	
+	void* const map = mmap(NULL, AUTOTUNE_SAMPLE_SIZE, PROT_READ, MAP_SHARED, fd, start);
+	
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	
+	#if defined(POSIX_MADV_SEQUENTIAL)
+		posix_madvise(map, AUTOTUNE_SAMPLE_SIZE, POSIX_MADV_SEQUENTIAL);
+	#endif
+	
+	reverse_memcpy(buffer, map, AUTOTUNE_SAMPLE_SIZE);
+	
+	munmap(map, AUTOTUNE_SAMPLE_SIZE);
+	
+	return (int64_t) (now() - begin);
+	
+}
+
+#endif
+
+static void identify(const unsigned long int device, char* const identity) {
+	/*
+	Describes a device in a way that outlives its number, which may be given to another
+	device after a reboot or hotplug. On Linux, this is the type and source of the
+	filesystem mounted from it, such as "ext4 /dev/nvme0n1p2", as listed in
+	/proc/self/mountinfo. Elsewhere, the identity is empty; on Windows, the number is
+	the serial number of the volume, which does not change.
+	*/
+	
+	*identity = '\0';
+	
+	#if defined(__linux__)
+		FILE* const file = fopen("/proc/self/mountinfo", "r");
+		
+		if (file == NULL) {
+			return;
+		}
+		
+		char expected[32];
+		const int expected_size = snprintf(expected, sizeof(expected), "%u:%u ", major((dev_t) device), minor((dev_t) device));
+		
+		char line[4096];
+		
+		while (fgets(line, sizeof(line), file) != NULL) {
+			// The third field is the device; the type and source follow a lone dash after the optional fields
+			const char* field = strchr(line, ' ');
+			field = (field == NULL) ? NULL : strchr(field + 1, ' ');
+			
+			if (field == NULL || strncmp(field + 1, expected, (size_t) expected_size) != 0) {
+				continue;
+			}
+			
+			char* const type = strstr(field, " - ");
+			
+			if (type == NULL) {
+				continue;
+			}
+			
+			char* const type_end = strchr(type + 3, ' ');
+			char* const source_end = (type_end == NULL) ? NULL : strpbrk(type_end + 1, " \n");
+			
+			if (source_end != NULL) {
+				*source_end = '\0';
+			}
+			
+			snprintf(identity, AUTOTUNE_IDENTITY_SIZE, "%s", type + 3);
+			
+			break;
+		}
+		
+		fclose(file);
+	#else
+		(void) device;
+	#endif
+	
+}
+
+static struct AutotuneProfile* find_device(const struct Autotune* const autotune, const unsigned long int device) {
+	
+	for (size_t index = 0; index < autotune->count; index++) {
+		if (autotune->profiles[index].device == device) {
+			return &autotune->profiles[index];
+		}
+	}
+	
+	return NULL;
+	
+}
+
+int autotune_load(struct Autotune* const autotune, const char* const path) {
+	/*
+	Loads the profiles saved at path, one per line: the device, the chunk size, the name
+	of the engine and the identity of the device. A missing file is not an error; there
+	are just no profiles yet.
+	
+	Lines that cannot be parsed are skipped.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(autotune, 0, sizeof(*autotune));
+	
+	autotune->path = malloc(strlen(path) + 1);
+	
+	if (autotune->path == NULL) {
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	strcpy(autotune->path, path);
+	
+	struct FStream* const stream = fstream_open(path, FSTREAM_READ);
+	
+	if (stream == NULL) {
+		#if defined(_WIN32)
+			const int missing = (GetLastError() == ERROR_FILE_NOT_FOUND || GetLastError() == ERROR_PATH_NOT_FOUND);
+		#else
+			const int missing = (errno == ENOENT);
+		#endif
+		
+		return missing ? 0 : -1;
+	}
+	
+	char* const content = malloc(AUTOTUNE_MAX_FILE_SIZE + 1);
+	
+	if (content == NULL) {
+		fstream_close(stream);
+		
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	size_t size = 0;
+	
+	while (size < AUTOTUNE_MAX_FILE_SIZE) {
+		const ssize_t rsize = fstream_read(stream, content + size, AUTOTUNE_MAX_FILE_SIZE - size);
+		
+		if (rsize == -1) {
+			free(content);
+			fstream_close(stream);
+			
+			return -1;
+		}
+		
+		if (rsize == 0) {
+			break;
+		}
+		
+		size += (size_t) rsize;
+	}
+	
+	fstream_close(stream);
+	
+	content[size] = '\0';
+	
+	size_t lines = 0;
+	
+	for (size_t index = 0; index < size; index++) {
+		lines += (content[index] == '\n');
+	}
+	
+	autotune->profiles = malloc((lines + 1) * sizeof(*autotune->profiles));
+	
+	if (autotune->profiles == NULL) {
+		free(content);
+		
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	char* line = content;
+	
+	while (*line != '\0') {
+		char* const line_end = strchr(line, '\n');
+		
+		if (line_end != NULL) {
+			*line_end = '\0';
+		}
+		
+		struct AutotuneProfile profile = {0};
+		
+		char* end = NULL;
+		
+		profile.device = strtoul(line, &end, 10);
+		
+		if (end != line && *end == ' ') {
+			const char* const chunk_size = end + 1;
+			profile.chunk_size = (size_t) strtoul(chunk_size, &end, 10);
+			
+			char* const engine = end + 1;
+			char* const identity = strchr(engine, ' ');
+			
+			if (identity != NULL) {
+				*identity = '\0';
+				snprintf(profile.identity, sizeof(profile.identity), "%s", identity + 1);
+			}
+			
+			if (end != chunk_size && *end == ' ' && profile.chunk_size > 0 && io_engine_parse(engine, &profile.engine) == 0) {
+				autotune->profiles[autotune->count++] = profile;
+			}
+		}
+		
+		if (line_end == NULL) {
+			break;
+		}
+		
+		line = line_end + 1;
+	}
+	
+	free(content);
+	
+	return 0;
+	
+}
+
+const struct AutotuneProfile* autotune_lookup(struct Autotune* const autotune, const unsigned long int device) {
+	/*
+	Returns the profile of the given device, or a null pointer if it was never measured,
+	or if its number now belongs to another device. The identity of a device is only
+	checked the first time its profile is looked up.
+	*/
+	
+	struct AutotuneProfile* const profile = find_device(autotune, device);
+	
+	if (profile == NULL) {
+		return NULL;
+	}
+	
+	if (profile->verified == 0) {
+		char identity[AUTOTUNE_IDENTITY_SIZE];
+		identify(device, identity);
+		
+		profile->verified = (strcmp(identity, profile->identity) == 0) ? 1 : -1;
+	}
+	
+	return (profile->verified == 1) ? profile : NULL;
+	
+}
+
+int autotune_measure(struct AutotuneProfile* const profile, const char* const filename) {
+	/*
+	Finds the best settings for the device filename lives on, by reading a sample of
+	filename backwards with each chunk size the stream engine could use, and once
+	through a memory mapping. Each candidate reads a different region of the file,
+	which is evicted from the page cache beforehand where possible.
+	
+	The file must be at least AUTOTUNE_MIN_FILE_SIZE bytes long; fails with EINVAL
+	otherwise. The device of profile is left as is.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) profile;
+		(void) filename;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#else
+		const int fd = open(filename, O_RDONLY);
+		
+		if (fd == -1) {
+			return -1;
+		}
+		
+		struct stat st = {0};
+		
+		if (fstat(fd, &st) == -1) {
+			const int error = errno;
+			close(fd);
+			
+			errno = error;
+			
+			return -1;
+		}
+		
+		if (!S_ISREG(st.st_mode) || st.st_size < AUTOTUNE_MIN_FILE_SIZE) {
+			close(fd);
+			errno = EINVAL;
+			
+			return -1;
+		}
+		
+		char* const buffer = malloc(AUTOTUNE_SAMPLE_SIZE * 2);
+		
+		if (buffer == NULL) {
+			close(fd);
+			errno = ENOMEM;
+			
+			return -1;
+		}
+		
+		// Regions are taken from the end of the file, which is what gets reversed first
+		off_t start = st.st_size - st.st_size % AUTOTUNE_SAMPLE_SIZE;
+		
+		int64_t best = -1;
+		
+		for (size_t index = 0; index < AUTOTUNE_CHUNK_SIZES_COUNT; index++) {
+			start -= AUTOTUNE_SAMPLE_SIZE;
+			
+			const int64_t elapsed = measure_stream(fd, buffer, AUTOTUNE_CHUNK_SIZES[index], start);
+			
+			if (elapsed == -1) {
+				const int error = errno;
+				free(buffer);
+				close(fd);
+				
+				errno = (error == 0) ? EIO : error;
+				
+				return -1;
+			}
+			
+			if (best == -1 || elapsed < best) {
+				best = elapsed;
+				
+				profile->chunk_size = AUTOTUNE_CHUNK_SIZES[index];
+				profile->engine = IO_ENGINE_STREAM;
+			}
+		}
+		
+		start -= AUTOTUNE_SAMPLE_SIZE;
+		
+		// Files that cannot be mapped are simply measured as worse than anything else
+		const int64_t elapsed = measure_mmap(fd, buffer, start);
+		
+		if (elapsed != -1 && elapsed < best) {
+			profile->engine = IO_ENGINE_MMAP;
+		}
+		
+		free(buffer);
+		close(fd);
+		
+		return 0;
+	#endif
+	
+}
+
+int autotune_store(struct Autotune* const autotune, const struct AutotuneProfile* const profile) {
+	/*
+	Adds or replaces the profile of a device, along with its current identity, and saves
+	all profiles back to the file they were loaded from. The file is replaced atomically, so that concurrent runs never
+	see it half written.
+	
+	The profile is kept in memory even if it could not be saved.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct AutotuneProfile* stored = find_device(autotune, profile->device);
+	
+	if (stored == NULL) {
+		struct AutotuneProfile* const profiles = realloc(autotune->profiles, (autotune->count + 1) * sizeof(*profiles));
+		
+		if (profiles == NULL) {
+			#if defined(_WIN32)
+				SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			#else
+				errno = ENOMEM;
+			#endif
+			
+			return -1;
+		}
+		
+		autotune->profiles = profiles;
+		stored = &autotune->profiles[autotune->count++];
+	}
+	
+	*stored = *profile;
+	
+	identify(stored->device, stored->identity);
+	stored->verified = 1;
+	
+	#if !defined(_WIN32)
+		// The cache directory itself may not exist yet
+		const char* const name = basename(autotune->path);
+		const size_t directory_size = (size_t) (name - autotune->path);
+		
+		if (directory_size > 1) {
+			char directory[directory_size];
+			
+			memcpy(directory, autotune->path, directory_size - 1);
+			directory[directory_size - 1] = '\0';
+			
+			if (mkdir(directory, 0700) == -1 && errno != EEXIST) {
+				return -1;
+			}
+		}
+	#endif
+	
+	char* const temporary = tempfile_name(autotune->path);
+	
+	if (temporary == NULL) {
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	struct FStream* const stream = fstream_open(temporary, FSTREAM_WRITE);
+	
+	if (stream == NULL) {
+		free(temporary);
+		return -1;
+	}
+	
+	int status = 0;
+	
+	for (size_t index = 0; index < autotune->count && status == 0; index++) {
+		const struct AutotuneProfile* const item = &autotune->profiles[index];
+		
+		char line[64 + AUTOTUNE_IDENTITY_SIZE];
+		const int size = snprintf(line, sizeof(line), "%lu %zu %s %s\n", item->device, item->chunk_size, io_engine_name(item->engine), item->identity);
+		
+		status = fstream_write(stream, line, (size_t) size);
+	}
+	
+	if (fstream_close(stream) == -1) {
+		status = -1;
+	}
+	
+	if (status == 0) {
+		status = move_file(temporary, autotune->path);
+	}
+	
+	if (status == -1) {
+		#if defined(_WIN32)
+			const DWORD error = GetLastError();
+			remove_file(temporary);
+			SetLastError(error);
+		#else
+			const int error = errno;
+			remove_file(temporary);
+			errno = error;
+		#endif
+	}
+	
+	free(temporary);
+	
+	return status;
+	
+}
+
+void autotune_free(struct Autotune* const autotune) {
+	
+	free(autotune->path);
+	free(autotune->profiles);
+	
+	memset(autotune, 0, sizeof(*autotune));
+	
+}
@@ -0,0 +1,38 @@
+#include <stdlib.h>
+
+#include "io_engine.h"
+
+// Files smaller than this are not used to measure a device
+#define AUTOTUNE_MIN_FILE_SIZE (40 * 1024 * 1024)
+
+// Room for the identity of a device, see autotune_identify()
+#define AUTOTUNE_IDENTITY_SIZE 256
+
+/*
+Best settings measured for the files of a device.
+
+Device numbers may be given to another device after a reboot or hotplug, so the
+identity of the device is kept along with its number; verified tells whether it was
+found to still match (1), not to (-1), or was not checked yet (0).
+*/
+struct AutotuneProfile {
+	unsigned long int device;
+	size_t chunk_size;
+	enum IOEngine engine;
+	char identity[AUTOTUNE_IDENTITY_SIZE];
+	int verified;
+};
+
+struct Autotune {
+	char* path;
+	struct AutotuneProfile* profiles;
+	size_t count;
+};
+
+int autotune_load(struct Autotune* const autotune, const char* const path);
+const struct AutotuneProfile* autotune_lookup(struct Autotune* const autotune, const unsigned long int device);
+int autotune_measure(struct AutotuneProfile* const profile, const char* const filename);
+int autotune_store(struct Autotune* const autotune, const struct AutotuneProfile* const profile);
+void autotune_free(struct Autotune* const autotune);
+
+#pragma once
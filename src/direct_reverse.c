@@ -0,0 +1,295 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#include "direct_reverse.h"
+#include "reverse_memcpy.h"
+
+#if !defined(_WIN32)
+
+// Amount of data transferred per request; a multiple of any sensible block size
+#define DIRECT_CHUNK_SIZE (8 * 1024 * 1024)
+
+// Used when the block size reported for the file is not usable as an alignment
+#define DIRECT_DEFAULT_ALIGNMENT 4096
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+	#define HAVE_POSIX_FALLOCATE 1
+#endif
+
+static void close_keep_errno(const int fd) {
+	
+	const int error = errno;
+	close(fd);
+	errno = error;
+	
+}
+
+static int open_direct(const char* const filename, const int flags) {
+	/*
+	Opens a file bypassing the page cache.
+	
+	Fails with EINVAL when the filesystem (or the platform) does not support it.
+	*/
+	
+	#if defined(O_DIRECT)
+		return open(filename, flags | O_DIRECT, 0666);
+	#elif defined(F_NOCACHE)
+		const int fd = open(filename, flags, 0666);
+		
+		if (fd == -1) {
+			return -1;
+		}
+		
+		if (fcntl(fd, F_NOCACHE, 1) == -1) {
+			close(fd);
+			
+			errno = EINVAL;
+			
+			return -1;
+		}
+		
+		return fd;
+	#else
+		(void) filename;
+		(void) flags;
+		
+		errno = EINVAL;
+		
+		return -1;
+	#endif
+	
+}
+
+static size_t pread_direct(const int fd, char* const buffer, const size_t size, const off_t offset) {
+	/*
+	Reads until the buffer is full or the end of the file is reached.
+	
+	Returns the number of bytes read, or (-1) cast to size_t on error.
+	*/
+	
+	size_t position = 0;
+	
+	while (position < size) {
+		const ssize_t rsize = pread(fd, buffer + position, size - position, offset + (off_t) position);
+		
+		if (rsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return (size_t) -1;
+		}
+		
+		if (rsize == 0) {
+			break;
+		}
+		
+		position += (size_t) rsize;
+	}
+	
+	return position;
+	
+}
+
+static int pwrite_direct(const int fd, const char* const buffer, const size_t size, const off_t offset) {
+	
+	size_t position = 0;
+	
+	while (position < size) {
+		const ssize_t wsize = pwrite(fd, buffer + position, size - position, offset + (off_t) position);
+		
+		if (wsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		position += (size_t) wsize;
+	}
+	
+	return 0;
+	
+}
+
+#endif
+
+int direct_reverse(const char* const source, const char* const destination, const long int block_size) {
+	/*
+	Writes the reversed content of source into destination without going through
+	the page cache.
+	
+	Both files are opened with O_DIRECT (F_NOCACHE on macOS), so every transfer
+	must start at an offset, and span a length, that are multiples of the block
+	size, from a buffer aligned to it. The block size is the one reported for
+	source by get_file_info().
+	
+	Destination chunks are always aligned, but the source range they mirror is
+	not unless the file size is a multiple of the block size. Each source range
+	is therefore widened to the enclosing blocks, and the unaligned head of the
+	file simply ends up short of a block when read. The last destination chunk
+	is padded up to a whole block, and the file is truncated back to its real
+	size at the end.
+	
+	Sets errno to EINVAL if either file cannot be accessed this way, which is what
+	filesystems without O_DIRECT support (such as tmpfs on older kernels) report;
+	callers can fall back to another method in that case, as source is left as is.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) source;
+		(void) destination;
+		(void) block_size;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#else
+		off_t alignment = (off_t) block_size;
+		
+		if (alignment < 512 || alignment > DIRECT_CHUNK_SIZE || (alignment & (alignment - 1)) != 0) {
+			alignment = DIRECT_DEFAULT_ALIGNMENT;
+		}
+		
+		const int input = open_direct(source, O_RDONLY);
+		
+		if (input == -1) {
+			return -1;
+		}
+		
+		struct stat st = {0};
+		
+		if (fstat(input, &st) == -1) {
+			close_keep_errno(input);
+			return -1;
+		}
+		
+		if (!S_ISREG(st.st_mode)) {
+			close(input);
+			errno = EINVAL;
+			
+			return -1;
+		}
+		
+		const int output = open_direct(destination, O_WRONLY | O_CREAT | O_TRUNC);
+		
+		if (output == -1) {
+			close_keep_errno(input);
+			return -1;
+		}
+		
+		const off_t size = st.st_size;
+		
+		#if defined(HAVE_POSIX_FALLOCATE)
+			if (size > 0) {
+				const int error = posix_fallocate(output, 0, size);
+				
+				// Not all filesystems support preallocation; that is not an error by itself
+				if (error != 0 && error != EINVAL && error != EOPNOTSUPP) {
+					close(input);
+					close(output);
+					
+					errno = error;
+					
+					return -1;
+				}
+			}
+		#endif
+		
+		void* read_buffer = NULL;
+		void* write_buffer = NULL;
+		
+		// A widened source range spans up to one extra block on each side
+		if (posix_memalign(&read_buffer, (size_t) alignment, DIRECT_CHUNK_SIZE + (size_t) alignment * 2) != 0) {
+			close(input);
+			close(output);
+			
+			errno = ENOMEM;
+			
+			return -1;
+		}
+		
+		if (posix_memalign(&write_buffer, (size_t) alignment, DIRECT_CHUNK_SIZE) != 0) {
+			free(read_buffer);
+			
+			close(input);
+			close(output);
+			
+			errno = ENOMEM;
+			
+			return -1;
+		}
+		
+		int status = 0;
+		
+		for (off_t offset = 0; offset < size; offset += DIRECT_CHUNK_SIZE) {
+			const off_t length = (size - offset < DIRECT_CHUNK_SIZE) ? size - offset : DIRECT_CHUNK_SIZE;
+			
+			const off_t start = size - offset - length;
+			const off_t end = size - offset;
+			
+			const off_t read_start = start - (start % alignment);
+			const off_t read_end = (end + alignment - 1) / alignment * alignment;
+			
+			const size_t rsize = pread_direct(input, read_buffer, (size_t) (read_end - read_start), read_start);
+			
+			if (rsize == (size_t) -1) {
+				status = -1;
+				break;
+			}
+			
+			// The file was truncated while it was being read
+			if ((off_t) rsize < end - read_start) {
+				errno = EIO;
+				status = -1;
+				
+				break;
+			}
+			
+			reverse_memcpy(write_buffer, (char*) read_buffer + (start - read_start), (size_t) length);
+			
+			const off_t write_length = (length + alignment - 1) / alignment * alignment;
+			memset((char*) write_buffer + length, 0, (size_t) (write_length - length));
+			
+			if (pwrite_direct(output, write_buffer, (size_t) write_length, offset) == -1) {
+				status = -1;
+				break;
+			}
+		}
+		
+		free(read_buffer);
+		free(write_buffer);
+		
+		// Drop the padding of the last block
+		if (status == 0 && size % alignment != 0 && ftruncate(output, size) == -1) {
+			status = -1;
+		}
+		
+		close_keep_errno(input);
+		
+		if (close(output) == -1) {
+			status = -1;
+		}
+		
+		return status;
+	#endif
+	
+}
@@ -0,0 +1,3 @@
+int direct_reverse(const char* const source, const char* const destination, const long int block_size);
+
+#pragma once
@@ -0,0 +1,28 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "durability.h"
+
+static const char* const DURABILITY_NAMES[] = {
+	"none",
+	"batch",
+	"file"
+};
+
+int durability_parse(const char* const name, enum Durability* const durability) {
+	/*
+	Looks up a durability level by its command line name.
+	
+	Returns (0) on success, (-1) if there is no level with that name.
+	*/
+	
+	for (size_t index = 0; index < (sizeof(DURABILITY_NAMES) / sizeof(*DURABILITY_NAMES)); index++) {
+		if (strcmp(DURABILITY_NAMES[index], name) == 0) {
+			*durability = (enum Durability) index;
+			return 0;
+		}
+	}
+	
+	return -1;
+	
+}
@@ -0,0 +1,9 @@
+enum Durability {
+	DURABILITY_NONE,
+	DURABILITY_BATCH,
+	DURABILITY_FILE
+};
+
+int durability_parse(const char* const name, enum Durability* const durability);
+
+#pragma once
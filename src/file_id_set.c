@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <pthread.h>
+#endif
+
+#include "file_id_set.h"
+
+// Number of independently locked parts of a set; a power of two
+#define FILE_ID_SET_SHARDS 64
+
+// Number of slots a shard starts with once its first ID is added; a power of two
+#define FILE_ID_SET_MIN_CAPACITY 64
+
+struct FileIDSetSlot {
+	struct FileID id;
+	int used;
+};
+
+struct FileIDSetShard {
+#if defined(_WIN32)
+	CRITICAL_SECTION lock;
+#else
+	pthread_mutex_t lock;
+#endif
+	struct FileIDSetSlot* slots;
+	size_t count;
+	size_t capacity;
+};
+
+static uint64_t hash_id(const struct FileID* const id) {
+	/*
+	Mixes the device and file number, so that the consecutive file numbers of a
+	filesystem spread evenly over shards and slots.
+	*/
+	
+	uint64_t hash = (uint64_t) id->file ^ ((uint64_t) id->device * 0x9e3779b97f4a7c15ULL);
+	
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	
+	return hash;
+	
+}
+
+static struct FileIDSetSlot* find_slot(struct FileIDSetSlot* const slots, const size_t capacity, const struct FileID* const id, const uint64_t hash) {
+	/*
+	Returns the slot holding id, or the free slot it belongs in.
+	*/
+	
+	// The low bits of the hash picked the shard; the next ones pick the slot
+	size_t index = (size_t) (hash / FILE_ID_SET_SHARDS) & (capacity - 1);
+	
+	while (slots[index].used && (slots[index].id.device != id->device || slots[index].id.file != id->file)) {
+		index = (index + 1) & (capacity - 1);
+	}
+	
+	return &slots[index];
+	
+}
+
+static int grow_shard(struct FileIDSetShard* const shard) {
+	/*
+	Doubles the number of slots of a shard, moving its IDs over.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const size_t capacity = (shard->capacity == 0) ? FILE_ID_SET_MIN_CAPACITY : shard->capacity * 2;
+	struct FileIDSetSlot* const slots = calloc(capacity, sizeof(*slots));
+	
+	if (slots == NULL) {
+		return -1;
+	}
+	
+	for (size_t index = 0; index < shard->capacity; index++) {
+		const struct FileIDSetSlot* const slot = &shard->slots[index];
+		
+		if (slot->used) {
+			*find_slot(slots, capacity, &slot->id, hash_id(&slot->id)) = *slot;
+		}
+	}
+	
+	free(shard->slots);
+	
+	shard->slots = slots;
+	shard->capacity = capacity;
+	
+	return 0;
+	
+}
+
+int file_id_set_init(struct FileIDSet* const set) {
+	/*
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	set->shards = calloc(FILE_ID_SET_SHARDS, sizeof(*set->shards));
+	
+	if (set->shards == NULL) {
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	for (size_t index = 0; index < FILE_ID_SET_SHARDS; index++) {
+		#if defined(_WIN32)
+			InitializeCriticalSection(&set->shards[index].lock);
+		#else
+			pthread_mutex_init(&set->shards[index].lock, NULL);
+		#endif
+	}
+	
+	return 0;
+	
+}
+
+int file_id_set_add(struct FileIDSet* const set, const struct FileID* const id) {
+	/*
+	Adds a file ID to the set, unless it is already there. Of several threads adding
+	the same ID at once, exactly one adds it.
+	
+	Returns (1) if the ID was added, (0) if it already was in the set, (-1) on error.
+	*/
+	
+	const uint64_t hash = hash_id(id);
+	struct FileIDSetShard* const shard = &set->shards[hash & (FILE_ID_SET_SHARDS - 1)];
+	
+	#if defined(_WIN32)
+		EnterCriticalSection(&shard->lock);
+	#else
+		pthread_mutex_lock(&shard->lock);
+	#endif
+	
+	int status = 1;
+	
+	// Shards are kept at most half full, so that probes stay short
+	if ((shard->count + 1) * 2 > shard->capacity && grow_shard(shard) == -1) {
+		status = -1;
+	} else {
+		struct FileIDSetSlot* const slot = find_slot(shard->slots, shard->capacity, id, hash);
+		
+		if (slot->used) {
+			status = 0;
+		} else {
+			slot->id = *id;
+			slot->used = 1;
+			
+			shard->count++;
+		}
+	}
+	
+	#if defined(_WIN32)
+		LeaveCriticalSection(&shard->lock);
+	#else
+		pthread_mutex_unlock(&shard->lock);
+	#endif
+	
+	if (status == -1) {
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+	}
+	
+	return status;
+	
+}
+
+void file_id_set_free(struct FileIDSet* const set) {
+	
+	if (set->shards == NULL) {
+		return;
+	}
+	
+	for (size_t index = 0; index < FILE_ID_SET_SHARDS; index++) {
+		struct FileIDSetShard* const shard = &set->shards[index];
+		
+		#if defined(_WIN32)
+			DeleteCriticalSection(&shard->lock);
+		#else
+			pthread_mutex_destroy(&shard->lock);
+		#endif
+		
+		free(shard->slots);
+	}
+	
+	free(set->shards);
+	set->shards = NULL;
+	
+}
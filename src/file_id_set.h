@@ -0,0 +1,20 @@
+#include <stdlib.h>
+
+#include "fileinfo.h"
+
+struct FileIDSetShard;
+
+/*
+Set of file IDs (device and file number) that is safe to use from several threads
+at once. IDs are spread over shards by hash, each with a lock and an open addressing
+table of its own, so that threads adding different IDs rarely wait for each other.
+*/
+struct FileIDSet {
+	struct FileIDSetShard* shards;
+};
+
+int file_id_set_init(struct FileIDSet* const set);
+int file_id_set_add(struct FileIDSet* const set, const struct FileID* const id);
+void file_id_set_free(struct FileIDSet* const set);
+
+#pragma once
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "file_order.h"
+
+static const char* const FILE_ORDER_NAMES[] = {
+	"directory",
+	"physical"
+};
+
+int file_order_parse(const char* const name, enum FileOrder* const order) {
+	/*
+	Looks up an order by its command line name.
+	
+	Returns (0) on success, (-1) if there is no order with that name.
+	*/
+	
+	for (size_t index = 0; index < (sizeof(FILE_ORDER_NAMES) / sizeof(*FILE_ORDER_NAMES)); index++) {
+		if (strcmp(FILE_ORDER_NAMES[index], name) == 0) {
+			*order = (enum FileOrder) index;
+			return 0;
+		}
+	}
+	
+	return -1;
+	
+}
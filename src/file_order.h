@@ -0,0 +1,8 @@
+enum FileOrder {
+	FILE_ORDER_DIRECTORY,
+	FILE_ORDER_PHYSICAL
+};
+
+int file_order_parse(const char* const name, enum FileOrder* const order);
+
+#pragma once
@@ -1,3 +1,7 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,6 +15,8 @@
 #endif
 
 #if !defined(_WIN32)
+	#include <stdio.h>
+	#include <fcntl.h>
 	#include <unistd.h>
 	#include <sys/stat.h>
 	#include <errno.h>
@@ -19,6 +25,7 @@
 #include "fstream.h"
 #include "constants.h"
 #include "filesystem.h"
+#include "stringu.h"
 
 #if defined(_WIN32)
 	int is_absolute(const char* const path) {
@@ -111,6 +118,71 @@ int remove_file(const char* const filename) {
 	
 }
 
+#if !defined(_WIN32) && !defined(__APPLE__)
+
+static int64_t copy_file_kernel(const int input, const int output) {
+	/*
+	Copies the content of input into output with copy_file_range(), which never brings
+	it to userspace and lets the filesystem share extents or offload the copy where it
+	can. Copying stops at the size the file had when this was called; the caller
+	finishes the copy with plain reads and writes from the returned offset, which also
+	covers files whose reported size is wrong (such as those in /proc) and systems
+	without copy_file_range().
+	
+	Returns the number of bytes copied, or (-1) on error.
+	*/
+	
+	#if defined(HAVE_COPY_FILE_RANGE)
+		struct stat st = {0};
+		
+		if (fstat(input, &st) == -1) {
+			return -1;
+		}
+		
+		if (!S_ISREG(st.st_mode)) {
+			return 0;
+		}
+		
+		off_t offset = 0;
+		
+		while (offset < st.st_size) {
+			off_t input_offset = offset;
+			off_t output_offset = offset;
+			
+			const ssize_t result = copy_file_range(input, &input_offset, output, &output_offset, (size_t) (st.st_size - offset), 0);
+			
+			if (result == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				
+				// Not supported by the kernel or between these filesystems
+				if (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF) {
+					break;
+				}
+				
+				return -1;
+			}
+			
+			if (result == 0) {
+				break;
+			}
+			
+			offset += (off_t) result;
+		}
+		
+		return (int64_t) offset;
+	#else
+		(void) input;
+		(void) output;
+		
+		return 0;
+	#endif
+	
+}
+
+#endif
+
 int copy_file(const char* const source, const char* const destination) {
 	/*
 	Copies a file from source to destination.
@@ -118,6 +190,8 @@ int copy_file(const char* const source, const char* const destination) {
 	On the Windows platform this will copy the source file's attributes into destination.
 	On Mac OS X, copyfile() C API will be used (available since OS X 10.5).
 	
+	Elsewhere, the copy is done within the kernel when possible (see copy_file_kernel()).
+	
 	If destination already exists, the file attributes will be preserved and the content overwritten.
 	
 	Returns (0) on success, (-1) on error.
@@ -193,7 +267,23 @@ int copy_file(const char* const source, const char* const destination) {
 			return -1;
 		}
 		
-		char chunk[8192] = {'\0'};
+		const int64_t copied = copy_file_kernel(istream->stream, ostream->stream);
+		
+		if (copied == -1) {
+			fstream_close(istream);
+			fstream_close(ostream);
+			return -1;
+		}
+		
+		// Finish whatever the kernel could not copy
+		if (fstream_seek(istream, copied, FSTREAM_SEEK_BEGIN) == -1 || fstream_seek(ostream, copied, FSTREAM_SEEK_BEGIN) == -1) {
+			fstream_close(istream);
+			fstream_close(ostream);
+			return -1;
+		}
+		
+		// Streams are unbuffered, so use chunks large enough to keep the number of system calls low
+		char chunk[64 * 1024] = {'\0'};
 		
 		while (1) {
 			const ssize_t size = fstream_read(istream, chunk, sizeof(chunk));
@@ -310,3 +400,208 @@ int move_file(const char* const source, const char* const destination) {
 	return 0;
 	
 }
+
+int create_directory(const char* const directory) {
+	/*
+	Creates a directory. Its parent must already exist.
+	
+	This does not fail if the directory already exists.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		#if defined(_UNICODE)
+			const int is_abs = is_absolute(directory);
+			
+			const int wdirectorys = MultiByteToWideChar(CP_UTF8, 0, directory, -1, NULL, 0);
+			
+			if (wdirectorys == 0) {
+				return -1;
+			}
+			
+			wchar_t wdirectory[(is_abs ? wcslen(WIN10LP_PREFIX) : 0) + wdirectorys];
+			
+			if (is_abs) {
+				wcscpy(wdirectory, WIN10LP_PREFIX);
+			}
+			
+			if (MultiByteToWideChar(CP_UTF8, 0, directory, -1, wdirectory + (is_abs ? wcslen(WIN10LP_PREFIX) : 0), wdirectorys) == 0) {
+				return -1;
+			}
+			
+			const BOOL status = CreateDirectoryW(wdirectory, NULL);
+		#else
+			const BOOL status = CreateDirectoryA(directory, NULL);
+		#endif
+		
+		if (status == 0 && GetLastError() != ERROR_ALREADY_EXISTS) {
+			return -1;
+		}
+	#else
+		if (mkdir(directory, 0777) == -1) {
+			struct stat st = {0};
+			
+			// Only an existing directory will do, not any other kind of file
+			if (errno != EEXIST || stat(directory, &st) == -1 || !S_ISDIR(st.st_mode)) {
+				return -1;
+			}
+		}
+	#endif
+	
+	return 0;
+	
+}
+
+int copy_file_mode(const char* const source, const char* const destination) {
+	/*
+	Gives destination the permissions of source.
+	
+	On Windows, files have no such permissions, so this does nothing.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) source;
+		(void) destination;
+	#else
+		struct stat st = {0};
+		
+		if (stat(source, &st) == -1) {
+			return -1;
+		}
+		
+		if (chmod(destination, st.st_mode & 07777) == -1) {
+			return -1;
+		}
+	#endif
+	
+	return 0;
+	
+}
+
+int sync_file(const char* const filename) {
+	/*
+	Waits until the content of a file has reached the storage device.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		#if defined(_UNICODE)
+			const int is_abs = is_absolute(filename);
+			
+			const int wfilenames = MultiByteToWideChar(CP_UTF8, 0, filename, -1, NULL, 0);
+			
+			if (wfilenames == 0) {
+				return -1;
+			}
+			
+			wchar_t wfilename[(is_abs ? wcslen(WIN10LP_PREFIX) : 0) + wfilenames];
+			
+			if (is_abs) {
+				wcscpy(wfilename, WIN10LP_PREFIX);
+			}
+			
+			if (MultiByteToWideChar(CP_UTF8, 0, filename, -1, wfilename + (is_abs ? wcslen(WIN10LP_PREFIX) : 0), wfilenames) == 0) {
+				return -1;
+			}
+			
+			const HANDLE handle = CreateFileW(wfilename, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		#else
+			const HANDLE handle = CreateFileA(filename, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		#endif
+		
+		if (handle == INVALID_HANDLE_VALUE) {
+			return -1;
+		}
+		
+		if (FlushFileBuffers(handle) == 0) {
+			const DWORD error = GetLastError();
+			CloseHandle(handle);
+			SetLastError(error);
+			
+			return -1;
+		}
+		
+		CloseHandle(handle);
+	#else
+		const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+		
+		if (fd == -1) {
+			return -1;
+		}
+		
+		if (fsync(fd) == -1) {
+			const int error = errno;
+			close(fd);
+			errno = error;
+			
+			return -1;
+		}
+		
+		close(fd);
+	#endif
+	
+	return 0;
+	
+}
+
+int sync_directory(const char* const directory) {
+	/*
+	Waits until the entries of a directory, such as the result of a rename, have reached
+	the storage device.
+	
+	On Windows, directories cannot be synced this way, so this does nothing.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) directory;
+	#else
+		const int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		
+		if (fd == -1) {
+			return -1;
+		}
+		
+		// Some filesystems do not support syncing directories, and have nothing to sync then
+		if (fsync(fd) == -1 && errno != EINVAL && errno != ENOTSUP) {
+			const int error = errno;
+			close(fd);
+			errno = error;
+			
+			return -1;
+		}
+		
+		close(fd);
+	#endif
+	
+	return 0;
+	
+}
+
+int sync_parent_directory(const char* const filename) {
+	/*
+	Syncs the directory holding filename, so that a rename onto filename survives a crash.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const char* const name = basename(filename);
+	const size_t directory_size = (size_t) (name - filename);
+	
+	char directory[directory_size + 2];
+	
+	if (directory_size == 0) {
+		strcpy(directory, ".");
+	} else {
+		memcpy(directory, filename, directory_size);
+		directory[directory_size] = '\0';
+	}
+	
+	return sync_directory(directory);
+	
+}
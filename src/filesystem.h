@@ -1,6 +1,11 @@
 int remove_file(const char* const filename);
 int move_file(const char* const source, const char* const destination);
 int copy_file(const char* const source, const char* const destination);
+int create_directory(const char* const directory);
+int copy_file_mode(const char* const source, const char* const destination);
+int sync_file(const char* const filename);
+int sync_directory(const char* const directory);
+int sync_parent_directory(const char* const filename);
 
 #if defined(_WIN32)
 	int is_absolute(const char* const path);
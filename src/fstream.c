@@ -1,3 +1,7 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 
 #if defined(_WIN32)
@@ -6,7 +10,11 @@
 #endif
 
 #if !defined(_WIN32)
-	#include <stdio.h>
+	#include <limits.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
 #endif
 
 #include "fstream.h"
@@ -16,20 +24,20 @@
 #endif
 
 /*
-fseeko()/ftello() availability:
+On Unix-like systems, streams are plain file descriptors accessed with pread() and
+pwrite() at a file position kept in the stream itself. Seeking is thus free, and
+data is never copied through an intermediate userspace buffer.
 
-On Linux: available when defined(_LARGEFILE64_SOURCE) or _POSIX_C_SOURCE >= 200112L
-On Apple, Android, Haiku and SerenityOS: available by default
-On FreeBSD and DragonFly BSD: available when __POSIX_VISIBLE >= 200112 or __XSI_VISIBLE >= 500
-On NetBSD: available when __POSIX_VISIBLE >= 200112 or __XSI_VISIBLE >= 500 or defined(_NETBSD_SOURCE)
+Offsets are 64-bit everywhere; 32-bit targets are built with _FILE_OFFSET_BITS=64
+so that off_t is wide enough too.
 */
 
-#if ((defined(__linux__) && (defined(_LARGEFILE64_SOURCE) || _POSIX_C_SOURCE >= 200112L)) || defined(__HAIKU__) || defined(__serenity__) || \
-	((defined(__FreeBSD__) || defined(__DragonFly__)) && (__POSIX_VISIBLE >= 200112 || __XSI_VISIBLE >= 500)) || \
-	defined(__OpenBSD__) || (defined(__NetBSD__) && (__POSIX_VISIBLE >= 200112 || __XSI_VISIBLE >= 500 || defined(_NETBSD_SOURCE))) || \
-	defined(__ANDROID__) || defined(__APPLE__))
-	#define HAVE_FSEEKO 1
-	#define HAVE_FTELLO 1
+#if !defined(O_NOATIME)
+	#define O_NOATIME 0
+#endif
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+	#define HAVE_POSIX_FALLOCATE 1
 #endif
 
 struct FStream* fstream_open(const char* const filename, const enum FStreamMode mode) {
@@ -105,23 +113,28 @@ struct FStream* fstream_open(const char* const filename, const enum FStreamMode
 			}
 		}
 	#else
-		const char* fmode = NULL;
+		int flags = 0;
 		
 		switch (mode) {
 			case FSTREAM_WRITE:
-				fmode = "wb";
+				flags = O_WRONLY | O_CREAT | O_TRUNC;
 				break;
 			case FSTREAM_READ:
-				fmode = "r";
+				flags = O_RDONLY;
 				break;
 			case FSTREAM_APPEND:
-				fmode = "a";
+				flags = O_WRONLY | O_APPEND;
 				break;
 		}
 		
-		FILE* handle = fopen(filename, fmode);
+		// Reading a file should not cost a metadata write; this is only permitted to the file owner
+		int handle = open(filename, flags | (mode == FSTREAM_READ ? O_NOATIME : 0), 0666);
+		
+		if (handle == -1 && errno == EPERM && mode == FSTREAM_READ && O_NOATIME != 0) {
+			handle = open(filename, flags);
+		}
 		
-		if (handle == NULL) {
+		if (handle == -1) {
 			return NULL;
 		}
 	#endif
@@ -129,11 +142,23 @@ struct FStream* fstream_open(const char* const filename, const enum FStreamMode
 	struct FStream* const stream = malloc(sizeof(struct FStream));
 	
 	if (stream == NULL) {
+		#if defined(_WIN32)
+			CloseHandle(handle);
+		#else
+			close(handle);
+			errno = ENOMEM;
+		#endif
+		
 		return NULL;
 	}
 	
 	stream->stream = handle;
 	
+	#if !defined(_WIN32)
+		stream->append = (mode == FSTREAM_APPEND);
+		stream->offset = 0;
+	#endif
+	
 	return stream;
 	
 }
@@ -155,17 +180,21 @@ ssize_t fstream_read(struct FStream* const stream, char* const buffer, const siz
 		
 		return (rsize > 0) ? (ssize_t) rsize : 0;
 	#else
-		const size_t rsize = fread(buffer, sizeof(*buffer), size, stream->stream);
-		
-		if (rsize == 0) {
-			if (ferror(stream->stream) != 0) {
+		while (1) {
+			const ssize_t rsize = pread(stream->stream, buffer, size, (off_t) stream->offset);
+			
+			if (rsize == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				
 				return -1;
 			}
 			
-			return 0;
+			stream->offset += rsize;
+			
+			return rsize;
 		}
-		
-		return (ssize_t) rsize;
 	#endif
 	
 }
@@ -185,18 +214,32 @@ int fstream_write(struct FStream* const stream, const char* const buffer, const
 			return -1;
 		}
 	#else
-		const size_t wsize = fwrite(buffer, sizeof(*buffer), size, stream->stream);
+		size_t position = 0;
 		
-		if (wsize != size) {
-			return -1;
+		while (position < size) {
+			const ssize_t wsize = stream->append ?
+				write(stream->stream, buffer + position, size - position) :
+				pwrite(stream->stream, buffer + position, size - position, (off_t) (stream->offset + (int64_t) position));
+			
+			if (wsize == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				
+				return -1;
+			}
+			
+			position += (size_t) wsize;
 		}
+		
+		stream->offset += (int64_t) size;
 	#endif
 	
 	return 0;
 	
 }
 
-int fstream_seek(struct FStream* const stream, const long int offset, const enum FStreamSeek method) {
+int fstream_seek(struct FStream* const stream, const int64_t offset, const enum FStreamSeek method) {
 	/*
 	Sets the current file position.
 	
@@ -218,40 +261,47 @@ int fstream_seek(struct FStream* const stream, const long int offset, const enum
 				break;
 		}
 		
-		if (SetFilePointer(stream->stream, offset, NULL, whence) == INVALID_SET_FILE_POINTER) {
+		LARGE_INTEGER distance = {0};
+		distance.QuadPart = offset;
+		
+		if (SetFilePointerEx(stream->stream, distance, NULL, whence) == 0) {
 			return -1;
 		}
 	#else
-		int whence = 0;
+		int64_t base = 0;
 		
 		switch (method) {
 			case FSTREAM_SEEK_BEGIN:
-				whence = SEEK_SET;
+				base = 0;
 				break;
 			case FSTREAM_SEEK_CURRENT:
-				whence = SEEK_CUR;
+				base = stream->offset;
 				break;
-			case FSTREAM_SEEK_END:
-				whence = SEEK_END;
+			case FSTREAM_SEEK_END: {
+				struct stat st = {0};
+				
+				if (fstat(stream->stream, &st) == -1) {
+					return -1;
+				}
+				
+				base = (int64_t) st.st_size;
 				break;
+			}
 		}
 		
-		#if defined(HAVE_FSEEKO)
-			if (fseeko(stream->stream, offset, whence) != 0) {
-				return -1;
-			}
-		#else
-			if (fseek(stream->stream, offset, whence) != 0) {
-				return -1;
-			}
-		#endif
+		if (base + offset < 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		
+		stream->offset = base + offset;
 	#endif
 	
 	return 0;
 	
 }
 
-long int fstream_tell(struct FStream* const stream) {
+int64_t fstream_tell(struct FStream* const stream) {
 	/*
 	Returns the current file offset.
 	
@@ -259,24 +309,97 @@ long int fstream_tell(struct FStream* const stream) {
 	*/
 	
 	#if defined(_WIN32)
-		const DWORD value = SetFilePointer(stream->stream, 0, NULL, FILE_CURRENT);
+		const LARGE_INTEGER distance = {0};
+		LARGE_INTEGER value = {0};
 		
-		if (value == INVALID_SET_FILE_POINTER) {
+		if (SetFilePointerEx(stream->stream, distance, &value, FILE_CURRENT) == 0) {
 			return -1;
 		}
+		
+		return (int64_t) value.QuadPart;
 	#else
-		#if defined(HAVE_FTELLO)
-			const long int value = ftello(stream->stream);
-		#else
-			const long int value = ftell(stream->stream);
-		#endif
+		return stream->offset;
+	#endif
+	
+}
+
+int fstream_advise(struct FStream* const stream, const int64_t offset, const int64_t size, const enum FStreamAdvice advice) {
+	/*
+	Tells the operating system how a range of the file is going to be accessed.
+	
+	FSTREAM_ADVICE_RANDOM disables the readahead done on sequential reads (offset and size
+	are ignored), and FSTREAM_ADVICE_WILLNEED starts reading the range in the background.
+	
+	This is only a hint; platforms without a way to pass it along do nothing.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) stream;
+		(void) offset;
+		(void) size;
+		(void) advice;
+	#elif defined(__APPLE__)
+		if (advice == FSTREAM_ADVICE_RANDOM) {
+			if (fcntl(stream->stream, F_RDAHEAD, 0) == -1) {
+				return -1;
+			}
+		} else {
+			struct radvisory hint = {
+				.ra_offset = (off_t) offset,
+				.ra_count = (size > INT_MAX) ? INT_MAX : (int) size
+			};
+			
+			if (fcntl(stream->stream, F_RDADVISE, &hint) == -1) {
+				return -1;
+			}
+		}
+	#elif defined(POSIX_FADV_WILLNEED)
+		const int error = (advice == FSTREAM_ADVICE_RANDOM) ?
+			posix_fadvise(stream->stream, 0, 0, POSIX_FADV_RANDOM) :
+			posix_fadvise(stream->stream, (off_t) offset, (off_t) size, POSIX_FADV_WILLNEED);
 		
-		if (value == -1) {
+		if (error != 0) {
+			errno = error;
 			return -1;
 		}
+	#else
+		(void) stream;
+		(void) offset;
+		(void) size;
+		(void) advice;
+	#endif
+	
+	return 0;
+	
+}
+
+int fstream_allocate(struct FStream* const stream, const int64_t size) {
+	/*
+	Reserves disk space for the first size bytes of the file, so that writing them
+	neither fragments the file nor runs out of space halfway through.
+	
+	Filesystems and platforms without support for preallocation are not an error.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(HAVE_POSIX_FALLOCATE)
+		if (size > 0) {
+			const int error = posix_fallocate(stream->stream, 0, (off_t) size);
+			
+			if (error != 0 && error != EINVAL && error != EOPNOTSUPP) {
+				errno = error;
+				return -1;
+			}
+		}
+	#else
+		(void) stream;
+		(void) size;
 	#endif
 	
-	return value;
+	return 0;
 	
 }
 
@@ -298,12 +421,15 @@ int fstream_close(struct FStream* const stream) {
 			stream->stream = 0;
 		}
 	#else
-		if (stream->stream != NULL) {
-			if (fclose(stream->stream) != 0) {
+		if (stream->stream != -1) {
+			const int status = close(stream->stream);
+			
+			stream->stream = -1;
+			
+			if (status == -1) {
+				free(stream);
 				return -1;
 			}
-			
-			stream->stream = NULL;
 		}
 	#endif
 	
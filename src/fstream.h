@@ -1,16 +1,19 @@
 #include <stdlib.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 	#include <windows.h>
 #else
-	#include <stdio.h>
+	#include <sys/types.h>
 #endif
 
 struct FStream {
 #ifdef _WIN32
 	HANDLE stream;
 #else
-	FILE* stream;
+	int stream;
+	int append;
+	int64_t offset;
 #endif
 };
 
@@ -26,11 +29,18 @@ enum FStreamSeek {
 	FSTREAM_SEEK_END
 };
 
+enum FStreamAdvice {
+	FSTREAM_ADVICE_RANDOM,
+	FSTREAM_ADVICE_WILLNEED
+};
+
 struct FStream* fstream_open(const char* const filename, const enum FStreamMode mode);
 ssize_t fstream_read(struct FStream* const stream, char* const buffer, const size_t size);
 int fstream_write(struct FStream* const stream, const char* const buffer, const size_t size);
-int fstream_seek(struct FStream* const stream, const long int offset, const enum FStreamSeek method);
-long int fstream_tell(struct FStream* const stream);
+int fstream_seek(struct FStream* const stream, const int64_t offset, const enum FStreamSeek method);
+int64_t fstream_tell(struct FStream* const stream);
+int fstream_advise(struct FStream* const stream, const int64_t offset, const int64_t size, const enum FStreamAdvice advice);
+int fstream_allocate(struct FStream* const stream, const int64_t size);
 int fstream_close(struct FStream* const stream);
 
 #pragma once
@@ -0,0 +1,452 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#include "inplace.h"
+#include "reverse_memcpy.h"
+
+#if !defined(_WIN32)
+
+// Size of each of the two mirrored regions swapped per step
+#define INPLACE_CHUNK_SIZE (1024 * 1024)
+
+#define INPLACE_JOURNAL_SUFFIX ".revf-journal"
+
+#if defined(__APPLE__)
+	#define fdatasync fsync
+#endif
+
+static const char INPLACE_JOURNAL_MAGIC[8] = {'R', 'E', 'V', 'F', 'J', 'N', 'L', '1'};
+
+/*
+The undo journal holds two slots, each one made of a header followed by the original
+contents of the regions about to be overwritten by a step. Steps alternate between the
+slots, so a crash while a slot is being written always leaves the other one intact.
+
+Recovery picks the valid slot with the highest sequence number and writes its data back.
+This either undoes a partially written step or a fully completed one; in both cases the
+file ends up in the state it was before that step, and the reversal resumes from there.
+*/
+struct InPlaceJournalHeader {
+	char magic[8];
+	uint64_t sequence;
+	uint64_t device;
+	uint64_t inode;
+	uint64_t size;
+	uint64_t head_offset;
+	uint64_t tail_offset;
+	uint64_t length;
+	uint64_t checksum;
+};
+
+struct InPlaceJournal {
+	int fd;
+	uint64_t sequence;
+	uint64_t device;
+	uint64_t inode;
+	uint64_t size;
+};
+
+static int pread_full(const int fd, char* const buffer, const size_t size, const off_t offset) {
+	
+	size_t position = 0;
+	
+	while (position < size) {
+		const ssize_t rsize = pread(fd, buffer + position, size - position, offset + (off_t) position);
+		
+		if (rsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		if (rsize == 0) {
+			errno = EIO;
+			return -1;
+		}
+		
+		position += (size_t) rsize;
+	}
+	
+	return 0;
+	
+}
+
+static int pwrite_full(const int fd, const char* const buffer, const size_t size, const off_t offset) {
+	
+	size_t position = 0;
+	
+	while (position < size) {
+		const ssize_t wsize = pwrite(fd, buffer + position, size - position, offset + (off_t) position);
+		
+		if (wsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		position += (size_t) wsize;
+	}
+	
+	return 0;
+	
+}
+
+static uint64_t journal_checksum(const struct InPlaceJournalHeader* const header, const char* const data, const size_t size) {
+	/*
+	FNV-1a over the header (with the checksum field zeroed) and the region data.
+	*/
+	
+	struct InPlaceJournalHeader copy = *header;
+	copy.checksum = 0;
+	
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	
+	const unsigned char* bytes = (const unsigned char*) &copy;
+	
+	for (size_t index = 0; index < sizeof(copy); index++) {
+		hash = (hash ^ bytes[index]) * 0x100000001B3ULL;
+	}
+	
+	bytes = (const unsigned char*) data;
+	
+	for (size_t index = 0; index < size; index++) {
+		hash = (hash ^ bytes[index]) * 0x100000001B3ULL;
+	}
+	
+	return hash;
+	
+}
+
+static off_t journal_slot_offset(const uint64_t sequence) {
+	
+	return (off_t) ((sequence % 2) * (sizeof(struct InPlaceJournalHeader) + INPLACE_CHUNK_SIZE * 2));
+	
+}
+
+static size_t journal_data_size(const struct InPlaceJournalHeader* const header) {
+	
+	return (size_t) (header->head_offset == header->tail_offset ? header->length : header->length * 2);
+	
+}
+
+static int journal_record(
+	struct InPlaceJournal* const journal,
+	char* const buffer,
+	const uint64_t head_offset,
+	const uint64_t tail_offset,
+	const uint64_t length
+) {
+	/*
+	Saves the original contents of the regions about to be overwritten.
+	
+	The buffer must hold the head region followed by the tail region (or just the
+	middle region when both offsets are equal).
+	*/
+	
+	struct InPlaceJournalHeader header = {0};
+	
+	memcpy(header.magic, INPLACE_JOURNAL_MAGIC, sizeof(header.magic));
+	header.sequence = journal->sequence;
+	header.device = journal->device;
+	header.inode = journal->inode;
+	header.size = journal->size;
+	header.head_offset = head_offset;
+	header.tail_offset = tail_offset;
+	header.length = length;
+	
+	const size_t size = journal_data_size(&header);
+	
+	header.checksum = journal_checksum(&header, buffer, size);
+	
+	const off_t offset = journal_slot_offset(journal->sequence);
+	
+	if (pwrite_full(journal->fd, buffer, size, offset + (off_t) sizeof(header)) == -1) {
+		return -1;
+	}
+	
+	if (pwrite_full(journal->fd, (const char*) &header, sizeof(header), offset) == -1) {
+		return -1;
+	}
+	
+	if (fsync(journal->fd) == -1) {
+		return -1;
+	}
+	
+	journal->sequence++;
+	
+	return 0;
+	
+}
+
+static int journal_recover(
+	struct InPlaceJournal* const journal,
+	const int fd,
+	char* const buffer,
+	uint64_t* const start,
+	uint64_t* const end
+) {
+	/*
+	Looks for a valid slot left behind by an interrupted run and undoes its step.
+	
+	On success, start and end are set to the bounds of the range still left to reverse.
+	Slots that belong to another file, or that were only partially written, are ignored.
+	*/
+	
+	struct InPlaceJournalHeader latest = {0};
+	int found = 0;
+	
+	for (uint64_t slot = 0; slot < 2; slot++) {
+		struct InPlaceJournalHeader header = {0};
+		
+		const off_t offset = journal_slot_offset(slot);
+		const ssize_t rsize = pread(journal->fd, &header, sizeof(header), offset);
+		
+		if (rsize == -1) {
+			return -1;
+		}
+		
+		if ((size_t) rsize != sizeof(header) || memcmp(header.magic, INPLACE_JOURNAL_MAGIC, sizeof(header.magic)) != 0) {
+			continue;
+		}
+		
+		if (header.device != journal->device || header.inode != journal->inode || header.size != journal->size) {
+			continue;
+		}
+		
+		if (header.length > INPLACE_CHUNK_SIZE * 2 || (header.head_offset != header.tail_offset && header.length > INPLACE_CHUNK_SIZE)) {
+			continue;
+		}
+		
+		if (header.head_offset > header.tail_offset || header.tail_offset + header.length > header.size) {
+			continue;
+		}
+		
+		const size_t size = journal_data_size(&header);
+		
+		if (pread_full(journal->fd, buffer, size, offset + (off_t) sizeof(header)) == -1) {
+			if (errno == EIO) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		if (journal_checksum(&header, buffer, size) != header.checksum) {
+			continue;
+		}
+		
+		if (!found || header.sequence > latest.sequence) {
+			latest = header;
+			found = 1;
+		}
+	}
+	
+	if (!found) {
+		return 0;
+	}
+	
+	const off_t offset = journal_slot_offset(latest.sequence);
+	
+	if (pread_full(journal->fd, buffer, journal_data_size(&latest), offset + (off_t) sizeof(latest)) == -1) {
+		return -1;
+	}
+	
+	if (pwrite_full(fd, buffer, (size_t) latest.length, (off_t) latest.head_offset) == -1) {
+		return -1;
+	}
+	
+	if (latest.head_offset != latest.tail_offset) {
+		if (pwrite_full(fd, buffer + latest.length, (size_t) latest.length, (off_t) latest.tail_offset) == -1) {
+			return -1;
+		}
+	}
+	
+	if (fdatasync(fd) == -1) {
+		return -1;
+	}
+	
+	*start = latest.head_offset;
+	*end = latest.tail_offset + latest.length;
+	
+	journal->sequence = latest.sequence + 1;
+	
+	return 0;
+	
+}
+
+#endif
+
+int inplace_reverse(const char* const filename, const int use_journal) {
+	/*
+	Reverses a file in place, without writing a temporary copy of it.
+	
+	Mirrored chunks are read from both ends of the file, reversed in memory and
+	written back to the opposite end, moving towards the middle. This needs no
+	extra disk space and reads and writes every byte exactly once.
+	
+	If use_journal is nonzero, the original contents of each pair of chunks are
+	saved to "<filename>.revf-journal" before they are overwritten, so that an
+	interrupted run can be resumed. An existing journal is always honored, even
+	if use_journal is zero, as the file would be left inconsistent otherwise.
+	The journal is removed once the file has been completely reversed.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) filename;
+		(void) use_journal;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#else
+		const int fd = open(filename, O_RDWR);
+		
+		if (fd == -1) {
+			return -1;
+		}
+		
+		struct stat st = {0};
+		
+		if (fstat(fd, &st) == -1) {
+			close(fd);
+			return -1;
+		}
+		
+		char journal_path[strlen(filename) + strlen(INPLACE_JOURNAL_SUFFIX) + 1];
+		strcpy(journal_path, filename);
+		strcat(journal_path, INPLACE_JOURNAL_SUFFIX);
+		
+		struct InPlaceJournal journal = {
+			.fd = -1,
+			.sequence = 0,
+			.device = (uint64_t) st.st_dev,
+			.inode = (uint64_t) st.st_ino,
+			.size = (uint64_t) st.st_size
+		};
+		
+		journal.fd = open(journal_path, O_RDWR | (use_journal ? O_CREAT : 0), S_IRUSR | S_IWUSR);
+		
+		if (journal.fd == -1 && (use_journal || errno != ENOENT)) {
+			close(fd);
+			return -1;
+		}
+		
+		char* const buffer = malloc(INPLACE_CHUNK_SIZE * 2);
+		
+		if (buffer == NULL) {
+			if (journal.fd != -1) {
+				close(journal.fd);
+			}
+			
+			close(fd);
+			
+			return -1;
+		}
+		
+		uint64_t start = 0;
+		uint64_t end = journal.size;
+		
+		int status = 0;
+		
+		if (journal.fd != -1) {
+			status = journal_recover(&journal, fd, buffer, &start, &end);
+		}
+		
+		while (status == 0 && end - start > 0) {
+			const uint64_t remaining = end - start;
+			
+			// Both regions are the same one once the middle of the file is reached
+			const uint64_t length = (remaining >= INPLACE_CHUNK_SIZE * 2) ? INPLACE_CHUNK_SIZE : remaining;
+			const uint64_t head_offset = start;
+			const uint64_t tail_offset = end - length;
+			
+			char* const head = buffer;
+			char* const tail = buffer + length;
+			
+			if (pread_full(fd, head, (size_t) length, (off_t) head_offset) == -1) {
+				status = -1;
+				break;
+			}
+			
+			if (head_offset != tail_offset && pread_full(fd, tail, (size_t) length, (off_t) tail_offset) == -1) {
+				status = -1;
+				break;
+			}
+			
+			if (journal.fd != -1 && journal_record(&journal, buffer, head_offset, tail_offset, length) == -1) {
+				status = -1;
+				break;
+			}
+			
+			if (head_offset == tail_offset) {
+				reverse_inplace(head, (size_t) length);
+				
+				if (pwrite_full(fd, head, (size_t) length, (off_t) head_offset) == -1) {
+					status = -1;
+					break;
+				}
+			} else {
+				reverse_inplace(head, (size_t) length);
+				reverse_inplace(tail, (size_t) length);
+				
+				if (pwrite_full(fd, tail, (size_t) length, (off_t) head_offset) == -1) {
+					status = -1;
+					break;
+				}
+				
+				if (pwrite_full(fd, head, (size_t) length, (off_t) tail_offset) == -1) {
+					status = -1;
+					break;
+				}
+			}
+			
+			// The step must be on disk before the next one overwrites the older journal slot
+			if (journal.fd != -1 && fdatasync(fd) == -1) {
+				status = -1;
+				break;
+			}
+			
+			if (head_offset == tail_offset) {
+				start = end;
+			} else {
+				start += length;
+				end -= length;
+			}
+		}
+		
+		free(buffer);
+		
+		if (journal.fd != -1) {
+			close(journal.fd);
+			
+			if (status == 0 && unlink(journal_path) == -1) {
+				status = -1;
+			}
+		}
+		
+		if (close(fd) == -1) {
+			status = -1;
+		}
+		
+		return status;
+	#endif
+	
+}
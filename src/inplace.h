@@ -0,0 +1,3 @@
+int inplace_reverse(const char* const filename, const int use_journal);
+
+#pragma once
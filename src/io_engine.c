@@ -0,0 +1,35 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "io_engine.h"
+
+static const char* const IO_ENGINE_NAMES[] = {
+	"auto",
+	"stream",
+	"mmap",
+	"uring"
+};
+
+int io_engine_parse(const char* const name, enum IOEngine* const engine) {
+	/*
+	Looks up an I/O engine by its command line name.
+	
+	Returns (0) on success, (-1) if there is no engine with that name.
+	*/
+	
+	for (size_t index = 0; index < (sizeof(IO_ENGINE_NAMES) / sizeof(*IO_ENGINE_NAMES)); index++) {
+		if (strcmp(IO_ENGINE_NAMES[index], name) == 0) {
+			*engine = (enum IOEngine) index;
+			return 0;
+		}
+	}
+	
+	return -1;
+	
+}
+
+const char* io_engine_name(const enum IOEngine engine) {
+	
+	return IO_ENGINE_NAMES[engine];
+	
+}
@@ -0,0 +1,11 @@
+enum IOEngine {
+	IO_ENGINE_AUTO,
+	IO_ENGINE_STREAM,
+	IO_ENGINE_MMAP,
+	IO_ENGINE_URING
+};
+
+int io_engine_parse(const char* const name, enum IOEngine* const engine);
+const char* io_engine_name(const enum IOEngine engine);
+
+#pragma once
@@ -1,27 +1,557 @@
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
 
 #if defined(_WIN32) && defined(_UNICODE)
 	#include <fcntl.h>
 	#include <io.h>
 #endif
 
+#if !defined(_WIN32)
+	#include <pthread.h>
+#endif
+
 #include "argparser.h"
+#include "autotune.h"
 #include "constants.h"
+#include "direct_reverse.h"
+#include "durability.h"
 #include "errors.h"
+#include "file_id_set.h"
+#include "file_order.h"
 #include "fileinfo.h"
 #include "filesystem.h"
 #include "fstream.h"
+#include "inplace.h"
+#include "io_engine.h"
+#include "mmap_reverse.h"
 #include "os.h"
+#include "parallel_reverse.h"
+#include "physical_order.h"
+#include "pipe_reverse.h"
 #include "reverse_memcpy.h"
 #include "revf.h"
+#include "sparse_reverse.h"
+#include "stdout_reverse.h"
 #include "stringu.h"
-#include "terminal.h"
+#include "sync_batch.h"
+#include "tempfile.h"
+#include "tree_reverse.h"
+#include "uring_reverse.h"
 #include "walkdir.h"
 
-static const char* temporary_directory = NULL;
+// Size of the blocks read and written by the stream engine, unless measured or given otherwise
+#define STREAM_CHUNK_SIZE (256 * 1024)
+
+// Upper bound for --chunk-size
+#define MAX_CHUNK_SIZE (1024 * 1024 * 1024)
+
+// Amount of memory standard input is buffered in before it is spilled to disk
+#define DEFAULT_MEMORY_LIMIT (256 * 1024 * 1024)
+
+// Name of the file device profiles are saved to, in the cache directory
+#define AUTOTUNE_PROFILE_FILENAME "revf.profile"
+
+// Amount of data requested ahead of the reads of the stream engine, which walk files backwards
+#define DEFAULT_READAHEAD_WINDOW (8 * 1024 * 1024)
+
+// Files smaller than this are reversed by a single thread, even with -j
+#define PARALLEL_MIN_FILE_SIZE (64 * 1024 * 1024)
+
+// Upper bound for -j
+#define MAX_JOBS 1024
+
+// Files smaller than this are not worth the cost of setting up memory mappings
+#define MMAP_MIN_FILE_SIZE (1024 * 1024)
+
+static enum IOEngine io_engine = IO_ENGINE_AUTO;
+static uint64_t readahead_window = DEFAULT_READAHEAD_WINDOW;
+static uint64_t chunk_size = 0;
+static uint64_t memory_limit = DEFAULT_MEMORY_LIMIT;
+
+static int in_place = 0;
+static int to_stdout = 0;
+static char* output_directory = NULL;
+static int journal = 0;
+static int direct = 0;
+static unsigned int jobs = 1;
+static int jobs_given = 0;
+
+static enum Durability durability = DURABILITY_NONE;
+static enum FileOrder file_order = FILE_ORDER_DIRECTORY;
+
+// Files with more than one hard link that were reversed in place so far, so that no other link reverses them back
+static struct FileIDSet linked_files = {0};
+
+// Directories walked so far, so that none is walked twice
+static struct FileIDSet walked_directories = {0};
+static int one_file_system = 0;
+static struct SyncBatch sync_batch = {0};
+
+static struct UringReverse uring = {0};
+static int uring_initialized = 0;
+
+static int autotune = 1;
+static int autotune_loaded = 0;
+static struct Autotune profiles = {0};
 
-static int file_reverse(const char* const filename) {
+#if !defined(_WIN32)
+	static pthread_mutex_t profiles_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void close_keep_error(struct FStream* const stream) {
+	
+	#if defined(_WIN32)
+		const DWORD error = GetLastError();
+		fstream_close(stream);
+		SetLastError(error);
+	#else
+		const int error = errno;
+		fstream_close(stream);
+		errno = error;
+	#endif
+	
+}
+
+static int stream_reverse(struct FStream* const source_stream, const char* const temporary_file, int64_t file_size, const size_t chunk_size) {
+	/*
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct FStream* destination_stream = fstream_open(temporary_file, FSTREAM_WRITE);
+	
+	if (destination_stream == NULL) {
+		return -1;
+	}
+	
+	if (fstream_allocate(destination_stream, file_size) == -1) {
+		close_keep_error(destination_stream);
+		return -1;
+	}
+	
+	// Reads and writes go straight to the kernel, so each chunk should be large enough to amortize the system calls
+	char* const chunk = malloc(chunk_size * 2);
+	
+	if (chunk == NULL) {
+		fstream_close(destination_stream);
+		
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	char* const reverse_chunk = chunk + chunk_size;
+	
+	/*
+	The kernel only detects forward sequential reads, so its readahead is turned off and
+	the ranges preceding the current chunk are requested explicitly instead. Everything
+	from the prefetched offset up to the end of the file has already been requested.
+	*/
+	const int64_t window = (int64_t) readahead_window;
+	int64_t prefetched = file_size;
+	
+	if (window > 0) {
+		fstream_advise(source_stream, 0, 0, FSTREAM_ADVICE_RANDOM);
+	}
+	
+	while (file_size != 0) {
+		const size_t rsize = (file_size < (int64_t) chunk_size) ? (size_t) file_size : chunk_size;
+		
+		file_size -= (int64_t) rsize;
+		
+		// Top the window up once less than half of it is left in flight ahead of this chunk
+		if (window > 0 && prefetched > 0 && file_size - prefetched < window / 2) {
+			const int64_t start = (file_size > window) ? file_size - window : 0;
+			
+			if (start < prefetched) {
+				fstream_advise(source_stream, start, prefetched - start, FSTREAM_ADVICE_WILLNEED);
+				prefetched = start;
+			}
+		}
+		
+		if (fstream_seek(source_stream, file_size, FSTREAM_SEEK_BEGIN) == -1) {
+			free(chunk);
+			close_keep_error(destination_stream);
+			
+			return -1;
+		}
+		
+		// A single read may return less than asked for; the file shrinking meanwhile ends it early
+		size_t position = 0;
+		
+		while (position < rsize) {
+			const ssize_t size = fstream_read(source_stream, chunk + position, rsize - position);
+			
+			if (size == 0) {
+				#if defined(_WIN32)
+					SetLastError(ERROR_HANDLE_EOF);
+				#else
+					errno = EIO;
+				#endif
+			}
+			
+			if (size <= 0) {
+				free(chunk);
+				close_keep_error(destination_stream);
+				
+				return -1;
+			}
+			
+			position += (size_t) size;
+		}
+		
+		reverse_memcpy(reverse_chunk, chunk, rsize);
+		
+		if (fstream_write(destination_stream, reverse_chunk, rsize) == -1) {
+			free(chunk);
+			close_keep_error(destination_stream);
+			
+			return -1;
+		}
+	}
+	
+	free(chunk);
+	
+	return fstream_close(destination_stream);
+	
+}
+
+static const struct AutotuneProfile* find_profile(const char* const filename, const int64_t file_size) {
+	/*
+	Returns the I/O profile of the device filename lives on. A device without one is
+	measured with the first file large enough, and the result is saved for later runs.
+	
+	Returns NULL if there is no profile to use.
+	*/
+	
+	if (!autotune) {
+		return NULL;
+	}
+	
+	if (!autotune_loaded) {
+		autotune_loaded = 1;
+		
+		char* const directory = get_cache_directory();
+		
+		if (directory == NULL) {
+			autotune = 0;
+			return NULL;
+		}
+		
+		char path[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(AUTOTUNE_PROFILE_FILENAME) + 1];
+		
+		strcpy(path, directory);
+		strcat(path, PATH_SEPARATOR);
+		strcat(path, AUTOTUNE_PROFILE_FILENAME);
+		
+		free(directory);
+		
+		// An unreadable profile file only means going without profiles
+		if (autotune_load(&profiles, path) == -1) {
+			autotune = 0;
+			return NULL;
+		}
+	}
+	
+	struct FileInfo info = {0};
+	
+	if (get_file_info(&info, filename) == -1) {
+		return NULL;
+	}
+	
+	const struct AutotuneProfile* const profile = autotune_lookup(&profiles, info.id.device);
+	
+	if (profile != NULL || file_size < AUTOTUNE_MIN_FILE_SIZE) {
+		return profile;
+	}
+	
+	struct AutotuneProfile measured = {
+		.device = info.id.device
+	};
+	
+	if (autotune_measure(&measured, filename) == -1) {
+		return NULL;
+	}
+	
+	// Failing to save the profile only means measuring the device again on the next run
+	autotune_store(&profiles, &measured);
+	
+	return autotune_lookup(&profiles, info.id.device);
+	
+}
+
+static int get_profile(const char* const filename, const int64_t file_size, struct AutotuneProfile* const profile) {
+	/*
+	Copies the I/O profile of the device filename lives on, see find_profile(). Threads
+	walking a tree look profiles up at the same time, so this is done under a lock,
+	which also keeps a device from being measured by several threads at once.
+	
+	Returns (1) if there is a profile to use, (0) otherwise.
+	*/
+	
+	#if !defined(_WIN32)
+		pthread_mutex_lock(&profiles_mutex);
+	#endif
+	
+	const struct AutotuneProfile* const found = find_profile(filename, file_size);
+	
+	if (found != NULL) {
+		*profile = *found;
+	}
+	
+	#if !defined(_WIN32)
+		pthread_mutex_unlock(&profiles_mutex);
+	#endif
+	
+	return (found != NULL);
+	
+}
+
+static int publish_sync_batch(void) {
+	/*
+	Syncs the files written since the last batch, and then replaces them.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (sync_batch.count == 0) {
+		return 0;
+	}
+	
+	if (sync_batch_publish(&sync_batch) == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not replace file at '%s': %s\r\n", sync_batch.error_path == NULL ? "" : sync_batch.error_path, error.message);
+		
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+static int finish_file(const char* const filename, struct TempFile* const tempfile) {
+	/*
+	Replaces filename with its reversed temporary file, or, without one, takes care of
+	filename itself having been written. Either way, the data is synced as --durability
+	asks; with batch, filename is only replaced once its whole batch is synced.
+	
+	The temporary file is released in all cases.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (sync_batch_finish(&sync_batch, durability, filename, tempfile) == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not %s file at '%s': %s\r\n", (tempfile == NULL) ? "sync" : "replace", sync_batch.error_path == NULL ? filename : sync_batch.error_path, error.message);
+		
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+static int content_reverse(struct FStream* const source_stream, const char* const filename, const int64_t file_size, const char* const output, const unsigned int threads) {
+	/*
+	Writes the reversed content of filename, opened as source_stream, into output. The
+	engine is picked from the command line, the profile of the device and the size of
+	the file; up to threads threads are used to split a large file.
+	
+	This is safe to call from several threads at once, as long as the io_uring engine
+	is not selected.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	enum IOEngine engine = io_engine;
+	size_t stream_chunk_size = (chunk_size == 0) ? STREAM_CHUNK_SIZE : (size_t) chunk_size;
+	
+	// Settings given on the command line always take precedence over measured ones
+	if (!direct && (io_engine == IO_ENGINE_AUTO || chunk_size == 0)) {
+		struct AutotuneProfile profile = {0};
+		
+		if (get_profile(filename, file_size, &profile)) {
+			if (io_engine == IO_ENGINE_AUTO && file_size >= MMAP_MIN_FILE_SIZE) {
+				engine = profile.engine;
+			}
+			
+			if (chunk_size == 0) {
+				stream_chunk_size = profile.chunk_size;
+			}
+		}
+	}
+	
+	#if !defined(_WIN32)
+		const int use_mmap = (engine == IO_ENGINE_MMAP || (engine == IO_ENGINE_AUTO && file_size >= MMAP_MIN_FILE_SIZE));
+	#else
+		const int use_mmap = (engine == IO_ENGINE_MMAP);
+	#endif
+	
+	// Holes are only worth preserving when the engine was not chosen explicitly
+	if (io_engine == IO_ENGINE_AUTO && !direct) {
+		if (sparse_reverse(filename, output) == 0) {
+			return 0;
+		}
+		
+		const struct SystemError error = get_system_error();
+		
+		// The file has no holes, or they cannot be found here; reverse all of it instead
+		#if defined(_WIN32)
+			const int unsupported = (error.code == ERROR_NOT_SUPPORTED);
+		#else
+			const int unsupported = (error.code == EINVAL);
+		#endif
+		
+		if (!unsupported) {
+			return -1;
+		}
+	}
+	
+	if (direct) {
+		struct FileInfo info = {0};
+		const long int block_size = (get_file_info(&info, filename) == 0) ? info.block_size : 0;
+		
+		if (direct_reverse(filename, output, block_size) == 0) {
+			return 0;
+		}
+		
+		const struct SystemError error = get_system_error();
+		
+		// The filesystem does not support direct I/O; go through the page cache instead
+		#if defined(_WIN32)
+			const int unsupported = (error.code == ERROR_NOT_SUPPORTED);
+		#else
+			const int unsupported = (error.code == EINVAL);
+		#endif
+		
+		if (!unsupported) {
+			return -1;
+		}
+	}
+	
+	// Splitting a file across threads is asked for with -j, and only when no engine was chosen for it otherwise
+	if (threads > 1 && engine == IO_ENGINE_AUTO && file_size >= PARALLEL_MIN_FILE_SIZE) {
+		if (parallel_reverse(filename, output, threads) == 0) {
+			return 0;
+		}
+		
+		// Threads are not supported on this platform; use a single one instead
+		#if defined(_WIN32)
+			if (GetLastError() != ERROR_NOT_SUPPORTED) {
+				return -1;
+			}
+		#else
+			return -1;
+		#endif
+	}
+	
+	if (use_mmap) {
+		if (mmap_reverse(filename, output) == 0) {
+			return 0;
+		}
+		
+		const struct SystemError error = get_system_error();
+		
+		// The file or filesystem does not support memory mappings; use the stream engine instead
+		if (io_engine != IO_ENGINE_AUTO || error.code != ENODEV) {
+			return -1;
+		}
+	}
+	
+	return stream_reverse(source_stream, output, file_size, stream_chunk_size);
+	
+}
+
+static int tree_content_reverse(const char* const filename, const char* const output) {
+	/*
+	Reverses a file found by the threads walking a tree, see content_reverse(). Large
+	files are not split, as every thread already reverses files of its own.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct FStream* const source_stream = fstream_open(filename, FSTREAM_READ);
+	
+	if (source_stream == NULL) {
+		return -1;
+	}
+	
+	int64_t file_size = -1;
+	
+	if (fstream_seek(source_stream, 0, FSTREAM_SEEK_END) == 0) {
+		file_size = fstream_tell(source_stream);
+	}
+	
+	if (file_size == -1 || fstream_seek(source_stream, 0, FSTREAM_SEEK_BEGIN) == -1 || content_reverse(source_stream, filename, file_size, output, 1) == -1) {
+		close_keep_error(source_stream);
+		return -1;
+	}
+	
+	fstream_close(source_stream);
+	
+	return 0;
+	
+}
+
+static int file_reverse(const char* const filename, const char* const destination) {
+	/*
+	Reverses a file. With a destination, the reversed content is written there and
+	filename is left as is; otherwise, filename is replaced.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (to_stdout) {
+		if (stdout_reverse(filename, fileno(stdout)) == -1) {
+			const struct SystemError error = get_system_error();
+			fprintf(stderr, "fatal error: could not write reversed file at '%s' to standard output: %s\r\n", filename, error.message);
+			
+			return -1;
+		}
+		
+		return 0;
+	}
+	
+	if (in_place) {
+		if (inplace_reverse(filename, journal) == -1) {
+			const struct SystemError error = get_system_error();
+			fprintf(stderr, "fatal error: could not reverse file in place at '%s': %s\r\n", filename, error.message);
+			
+			return -1;
+		}
+		
+		return finish_file(filename, NULL);
+	}
+	
+	// The io_uring engine goes through the page cache, so it is not used for --direct; it only ever replaces files either
+	if (io_engine == IO_ENGINE_URING && (direct || destination != NULL)) {
+		io_engine = IO_ENGINE_AUTO;
+	}
+	
+	if (io_engine == IO_ENGINE_URING && !uring_initialized) {
+		if (uring_reverse_init(&uring, durability) == 0) {
+			uring_initialized = 1;
+		} else {
+			// io_uring is not available here (old kernel, sandbox, or another platform)
+			io_engine = IO_ENGINE_AUTO;
+		}
+	}
+	
+	if (io_engine == IO_ENGINE_URING) {
+		if (uring_reverse_add(&uring, filename) == -1) {
+			const struct SystemError error = get_system_error();
+			fprintf(stderr, "fatal error: could not reverse file at '%s': %s\r\n", uring.error_path == NULL ? filename : uring.error_path, error.message);
+			
+			return -1;
+		}
+		
+		return 0;
+	}
 	
 	struct FStream* source_stream = fstream_open(filename, FSTREAM_READ);
 	
@@ -41,7 +571,7 @@ static int file_reverse(const char* const filename) {
 		return -1;
 	}
 	
-	long int file_size = fstream_tell(source_stream);
+	const int64_t file_size = fstream_tell(source_stream);
 	
 	if (file_size == -1) {
 		const struct SystemError error = get_system_error();
@@ -61,129 +591,308 @@ static int file_reverse(const char* const filename) {
 		return -1;
 	}
 	
-	const char* const name = basename(filename);
-	
-	char temporary_file[strlen(temporary_directory) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
-	strcpy(temporary_file, temporary_directory);
-	strcat(temporary_file, PATH_SEPARATOR);
-	strcat(temporary_file, name);
+	struct TempFile tempfile = {
+		.fd = -1
+	};
 	
-	struct FStream* destination_stream = fstream_open(temporary_file, FSTREAM_WRITE);
-	
-	if (destination_stream == NULL) {
+	// The destination of a mirrored file is written to directly; there is nothing there to keep intact
+	if (destination == NULL && tempfile_create(&tempfile, filename) == -1) {
 		const struct SystemError error = get_system_error();
-		fprintf(stderr, "fatal error: could not create file at '%s': %s\r\n", temporary_file, error.message);
+		fprintf(stderr, "fatal error: could not create temporary file for '%s': %s\r\n", filename, error.message);
 		
 		fstream_close(source_stream);
 		
 		return -1;
 	}
 	
-	char chunk[8192];
-	char reverse_chunk[8192];
+	const char* const temporary_file = (destination == NULL) ? tempfile.path : destination;
 	
-	while (file_size != 0) {
-		size_t rsize = sizeof(chunk);
-		
-		file_size -= rsize;
-		
-		if (file_size < 0) {
-			rsize -= (size_t) abs((int) file_size);
-			file_size -= file_size;
-		}
-		
-		if (fstream_seek(source_stream, file_size, FSTREAM_SEEK_BEGIN) == -1) {
-			const struct SystemError error = get_system_error();
-			fprintf(stderr, "fatal error: could not seek file at '%s': %s\r\n", filename, error.message);
-			
-			fstream_close(source_stream);
-			fstream_close(destination_stream);
-			
-			return -1;
-		}
+	if (content_reverse(source_stream, filename, file_size, temporary_file, jobs_given ? jobs : 1) == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not reverse file at '%s': %s\r\n", filename, error.message);
 		
-		const ssize_t size = fstream_read(source_stream, chunk, rsize);
+		fstream_close(source_stream);
+		tempfile_discard(&tempfile);
 		
-		if (size == -1) {
+		return -1;
+	}
+	
+	fstream_close(source_stream);
+	
+	source_stream = NULL;
+	
+	if (destination != NULL) {
+		if (copy_file_mode(filename, destination) == -1) {
 			const struct SystemError error = get_system_error();
-			fprintf(stderr, "fatal error: could not read contents of file at '%s': %s\r\n", filename, error.message);
-			
-			fstream_close(source_stream);
-			fstream_close(destination_stream);
+			fprintf(stderr, "fatal error: could not set permissions of file at '%s': %s\r\n", destination, error.message);
 			
 			return -1;
 		}
 		
-		reverse_memcpy(reverse_chunk, chunk, rsize);
-		
-		const int status = fstream_write(destination_stream, reverse_chunk, rsize);
+		return finish_file(destination, NULL);
+	}
+	
+	return finish_file(filename, &tempfile);
+	
+}
+
+static int skip_linked_file(const char* const filename, const char* const destination) {
+	/*
+	Checks whether filename is a hard link to a file that was already reversed, and
+	reports it if so. Reversing it again would restore the original content, at the
+	cost of reading and writing it all once more.
+	
+	Only --in-place writes to the file that all links share. Otherwise, replacing a
+	file only replaces the link it was reached through, and every link gets a reversed
+	copy of its own, so nothing is skipped.
+	
+	Returns (1) if the file is to be skipped, (0) if it is to be reversed, (-1) on error.
+	*/
+	
+	if (!in_place || destination != NULL) {
+		return 0;
+	}
+	
+	struct FileInfo info = {0};
+	
+	// Errors are left for reversing the file to report
+	if (get_file_info(&info, filename) == -1 || info.type != FILEINFO_FILE || info.total_links < 2) {
+		return 0;
+	}
+	
+	const int added = file_id_set_add(&linked_files, &info.id);
+	
+	if (added == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not keep track of hard links of file at '%s': %s\r\n", filename, error.message);
 		
-		if (status == -1) {
-			const struct SystemError error = get_system_error();
-			fprintf(stderr, "fatal error: could not write to file at '%s': %s\r\n", temporary_file, error.message);
-			
-			fstream_close(source_stream);
-			fstream_close(destination_stream);
-			
-			return -1;
-		}
+		return -1;
 	}
 	
-	fstream_close(source_stream);
-	fstream_close(destination_stream);
+	if (added == 0) {
+		fprintf(stderr, "skipped hard link at '%s': its file was already reversed\r\n", filename);
+		return 1;
+	}
 	
-	source_stream = NULL;
-	destination_stream = NULL;
+	return 0;
+	
+}
+
+static int skip_directory(const struct FileID* const id, const char* const directory, const unsigned long int device) {
+	/*
+	Checks whether a directory is to be left out of a walk: with -x, if it is on
+	another device than the directory the walk started from; otherwise, if it was
+	already walked, which is then reported.
+	
+	Symbolic links are never followed below the directories given on the command
+	line, so a directory can only be reached twice through a bind mount looping back
+	onto one of its ancestors, or by being given twice, possibly inside another one.
+	
+	Returns (1) if the directory is to be skipped, (0) if it is to be walked, (-1) on error.
+	*/
+	
+	if (one_file_system && id->device != device) {
+		return 1;
+	}
+	
+	const int added = file_id_set_add(&walked_directories, id);
 	
-	 if (move_file(temporary_file, filename) == -1) {
+	if (added == -1) {
 		const struct SystemError error = get_system_error();
-		fprintf(stderr, "fatal error: could not move file from '%s' to '%s': %s\r\n", temporary_file, filename, error.message);
+		fprintf(stderr, "fatal error: could not keep track of directory at '%s': %s\r\n", directory, error.message);
 		
 		return -1;
 	}
 	
+	if (added == 0) {
+		fprintf(stderr, "skipped directory at '%s': it was already walked\r\n", directory);
+		return 1;
+	}
+	
 	return 0;
 	
 }
 
-static int directory_reverse(const char* const directory) {
+static int physical_order_reverse(struct PhysicalOrder* const order) {
+	/*
+	Reverses the files of a batch in the order their data is laid out on the device,
+	and empties it.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	physical_order_sort(order);
+	
+	int status = 0;
+	
+	for (size_t index = 0; index < order->count && status == 0; index++) {
+		const struct PhysicalOrderItem* const item = &order->items[index];
+		status = file_reverse(item->source, item->destination);
+	}
+	
+	physical_order_clear(order);
+	
+	return status;
+	
+}
+
+static int directory_reverse(const char* const directory, const char* const destination) {
+	/*
+	Reverses all files under a directory, one at a time. With a destination, the tree
+	is recreated there with reversed files, and directory is left as is.
+	
+	The tree is walked without recursion. The destination path of each entry is built
+	like its source path: the part below the source directory is copied over that of
+	the previous entry, after the destination directory.
+	
+	With --order=physical, files are collected in batches of PHYSICAL_ORDER_SIZE, and
+	each batch is reversed in the order of the data of its files on the device, rather
+	than that of the directory entries, so that disks do not have to seek back and
+	forth between them.
+	
+	Returns (0) on success, (-1) on error.
+	*/
 	
 	struct WalkDir walkdir = {0};
 	
 	if (walkdir_init(&walkdir, directory) == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not open directory at '%s': %s\r\n", directory, error.message);
+		
 		return -1;
 	}
 	
-	while (1) {
+	struct FileID root = {0};
+	
+	if (walkdir_get_id(&walkdir, &root) == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not stat directory at '%s': %s\r\n", directory, error.message);
+		
+		walkdir_free(&walkdir);
+		
+		return -1;
+	}
+	
+	const int skip = skip_directory(&root, directory, root.device);
+	
+	if (skip != 0) {
+		walkdir_free(&walkdir);
+		return (skip == -1) ? -1 : 0;
+	}
+	
+	if (destination != NULL && create_directory(destination) == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not create directory at '%s': %s\r\n", destination, error.message);
+		
+		walkdir_free(&walkdir);
+		
+		return -1;
+	}
+	
+	const size_t directory_length = strlen(directory);
+	const size_t destination_length = (destination == NULL) ? 0 : strlen(destination);
+	
+	char* destination_path = NULL;
+	size_t destination_size = 0;
+	
+	struct PhysicalOrder order = {0};
+	
+	int status = 0;
+	
+	while (status == 0) {
 		const struct WalkDirItem* const item = walkdir_next(&walkdir);
 		
 		if (item == NULL) {
 			break;
 		}
 		
-		if (strcmp(item->name, ".") == 0 || strcmp(item->name, "..") == 0) {
-			continue;
+		if (destination != NULL) {
+			const size_t relative_length = strlen(item->path + directory_length);
+			const size_t size = destination_length + relative_length + 1;
+			
+			if (size > destination_size) {
+				char* const path = realloc(destination_path, size * 2);
+				
+				if (path == NULL) {
+					fprintf(stderr, "fatal error: could not allocate memory to walk directory at '%s'\r\n", directory);
+					
+					status = -1;
+					break;
+				}
+				
+				if (destination_path == NULL) {
+					memcpy(path, destination, destination_length);
+				}
+				
+				destination_path = path;
+				destination_size = size * 2;
+			}
+			
+			memcpy(destination_path + destination_length, item->path + directory_length, relative_length + 1);
 		}
 		
-		char path[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(item->name) + 1];
-		strcpy(path, directory);
-		strcat(path, PATH_SEPARATOR);
-		strcat(path, item->name);
-		
 		switch (item->type) {
 			case WALKDIR_ITEM_DIRECTORY: {
-				if (directory_reverse(path) == -1) {
-					walkdir_free(&walkdir);
-					return -1;
+				if (walkdir_enter(&walkdir) == -1) {
+					const struct SystemError error = get_system_error();
+					fprintf(stderr, "fatal error: could not open directory at '%s': %s\r\n", item->path, error.message);
+					
+					status = -1;
+					break;
+				}
+				
+				struct FileID id = {0};
+				
+				if (walkdir_get_id(&walkdir, &id) == -1) {
+					const struct SystemError error = get_system_error();
+					fprintf(stderr, "fatal error: could not stat directory at '%s': %s\r\n", item->path, error.message);
+					
+					status = -1;
+					break;
+				}
+				
+				const int skip = skip_directory(&id, item->path, root.device);
+				
+				if (skip != 0) {
+					walkdir_leave(&walkdir);
+					
+					status = (skip == -1) ? -1 : 0;
+					break;
+				}
+				
+				if (destination != NULL && create_directory(destination_path) == -1) {
+					const struct SystemError error = get_system_error();
+					fprintf(stderr, "fatal error: could not create directory at '%s': %s\r\n", destination_path, error.message);
+					
+					status = -1;
 				}
 				
 				break;
 			}
 			case WALKDIR_ITEM_FILE:
 			case WALKDIR_ITEM_UNKNOWN: {
-				if (file_reverse(path) == -1) {
-					walkdir_free(&walkdir);
-					return -1;
+				const char* const item_destination = (destination == NULL) ? NULL : destination_path;
+				const int skip = skip_linked_file(item->path, item_destination);
+				
+				if (skip != 0) {
+					status = (skip == -1) ? -1 : 0;
+					break;
+				}
+				
+				if (file_order == FILE_ORDER_DIRECTORY) {
+					status = file_reverse(item->path, item_destination);
+					break;
+				}
+				
+				if (physical_order_add(&order, item->path, item_destination) == -1) {
+					fprintf(stderr, "fatal error: could not allocate memory to walk directory at '%s'\r\n", directory);
+					
+					status = -1;
+					break;
+				}
+				
+				if (order.count == PHYSICAL_ORDER_SIZE) {
+					status = physical_order_reverse(&order);
 				}
 				
 				break;
@@ -191,12 +900,157 @@ static int directory_reverse(const char* const directory) {
 		}
 	}
 	
+	if (status == 0) {
+		status = physical_order_reverse(&order);
+	}
+	
+	physical_order_free(&order);
+	
+	free(destination_path);
 	walkdir_free(&walkdir);
 	
+	return status;
+	
+}
+
+static int stdin_reverse(void) {
+	/*
+	Writes the reversed content of standard input to standard output.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	char* const temporary_directory = get_temporary_directory();
+	
+	if (temporary_directory == NULL) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not get temporary directory: %s\r\n", error.message);
+		
+		return -1;
+	}
+	
+	// Anything already printed must come out before the reversed content
+	fflush(stdout);
+	
+	const int status = pipe_reverse(fileno(stdin), fileno(stdout), memory_limit, temporary_directory);
+	
+	free(temporary_directory);
+	
+	if (status == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not reverse standard input: %s\r\n", error.message);
+		
+		return -1;
+	}
+	
 	return 0;
 	
 }
 
+static int parallel_directory_reverse(const char* const directory, const char* const destination) {
+	/*
+	Reverses all files under a directory with -j threads, which walk the tree and reverse
+	files at the same time; see tree_reverse().
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct TreeReverse tree = {
+		.threads = jobs,
+		.reverse = tree_content_reverse,
+		.durability = durability,
+		.in_place = in_place,
+		.journal = journal,
+		.links = in_place ? &linked_files : NULL,
+		.directories = &walked_directories,
+		.one_file_system = one_file_system
+	};
+	
+	const int status = tree_reverse(&tree, directory, destination);
+	
+	for (size_t index = 0; index < tree.skipped_links.count; index++) {
+		fprintf(stderr, "skipped hard link at '%s': its file was already reversed\r\n", tree.skipped_links.paths[index]);
+	}
+	
+	for (size_t index = 0; index < tree.skipped_directories.count; index++) {
+		fprintf(stderr, "skipped directory at '%s': it was already walked\r\n", tree.skipped_directories.paths[index]);
+	}
+	
+	if (status == -1) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not reverse file at '%s': %s\r\n", tree.error_path == NULL ? directory : tree.error_path, error.message);
+		
+		tree_reverse_free(&tree);
+		
+		return -1;
+	}
+	
+	tree_reverse_free(&tree);
+	
+	return 0;
+	
+}
+
+static const char* get_option_value(struct ArgumentParser* const argparser, const struct Argument* const argument) {
+	/*
+	Returns the value of an option, given either along with it ("--jobs=4") or as the
+	next argument ("--jobs 4"), or an empty string if there is none.
+	
+	The value is only valid until the next argument is parsed.
+	*/
+	
+	if (argument->value != NULL) {
+		return argument->value;
+	}
+	
+	const struct Argument* const next = argparser_next(argparser);
+	
+	if (next == NULL) {
+		return "";
+	}
+	
+	return (next->value == NULL) ? next->key : next->value;
+	
+}
+
+static int exit_status(const int status) {
+	/*
+	Waits for the files still queued to the io_uring engine, and publishes those still
+	waiting for their batch to be synced, before exiting.
+	*/
+	
+	autotune_free(&profiles);
+	
+	free(output_directory);
+	output_directory = NULL;
+	
+	file_id_set_free(&linked_files);
+	file_id_set_free(&walked_directories);
+	
+	// Files reversed before an error are complete; they are published all the same
+	const int sync_status = publish_sync_batch();
+	sync_batch_free(&sync_batch);
+	
+	const int exit_code = (sync_status == -1) ? EXIT_FAILURE : status;
+	
+	if (!uring_initialized) {
+		return exit_code;
+	}
+	
+	const int wait_status = uring_reverse_wait(&uring);
+	
+	if (wait_status == -1 && exit_code == EXIT_SUCCESS) {
+		const struct SystemError error = get_system_error();
+		fprintf(stderr, "fatal error: could not reverse file at '%s': %s\r\n", uring.error_path == NULL ? "" : uring.error_path, error.message);
+	}
+	
+	uring_reverse_free(&uring);
+	uring_initialized = 0;
+	
+	return (wait_status == -1) ? EXIT_FAILURE : exit_code;
+	
+}
+
 int main(int argc, argv_t* argv[]) {
 	
 	#if defined(_WIN32) && defined(_UNICODE)
@@ -205,21 +1059,19 @@ int main(int argc, argv_t* argv[]) {
 		_setmode(_fileno(stdin), _O_WTEXT);
 	#endif
 	
-	if (!is_atty(stdin)) {
-		fprintf(stderr, "fatal error: will not read from standard input\r\n");
-		return EXIT_FAILURE;
-	}
-	
 	if (argc == 1) {
 		fprintf(stderr, "%s\n", REVF_DESCRIPTION);
 		return EXIT_FAILURE;
 	}
 	
-	temporary_directory = get_temporary_directory();
+	reverse_memcpy_init();
 	
-	if (temporary_directory == NULL) {
+	// Containers often get fewer CPUs than the machine has
+	jobs = get_cpu_count();
+	
+	if (file_id_set_init(&linked_files) == -1 || file_id_set_init(&walked_directories) == -1) {
 		const struct SystemError error = get_system_error();
-		fprintf(stderr, "fatal error: could not get temporary directory: %s\r\n", error.message);
+		fprintf(stderr, "fatal error: could not allocate memory to keep track of files: %s\r\n", error.message);
 		
 		return EXIT_FAILURE;
 	}
@@ -238,12 +1090,126 @@ int main(int argc, argv_t* argv[]) {
 		
 		if (strcmp(argument->key, "r") == 0 || strcmp(argument->key, "recursive") == 0) {
 			recursive = 1;
+		} else if (strcmp(argument->key, "x") == 0 || strcmp(argument->key, "one-file-system") == 0) {
+			one_file_system = 1;
+		} else if (strcmp(argument->key, "o") == 0 || strcmp(argument->key, "output") == 0) {
+			const char* const directory = get_option_value(&argparser, argument);
+			
+			if (*directory == '\0') {
+				fprintf(stderr, "fatal error: missing output directory\r\n");
+				return exit_status(EXIT_FAILURE);
+			}
+			
+			if (in_place || to_stdout) {
+				fprintf(stderr, "fatal error: an output directory cannot be used with --in-place or --stdout\r\n");
+				return exit_status(EXIT_FAILURE);
+			}
+			
+			free(output_directory);
+			output_directory = malloc(strlen(directory) + 1);
+			
+			if (output_directory == NULL) {
+				fprintf(stderr, "fatal error: could not allocate memory\r\n");
+				return exit_status(EXIT_FAILURE);
+			}
+			
+			strcpy(output_directory, directory);
+			
+			if (create_directory(output_directory) == -1) {
+				const struct SystemError error = get_system_error();
+				fprintf(stderr, "fatal error: could not create directory at '%s': %s\r\n", output_directory, error.message);
+				
+				return exit_status(EXIT_FAILURE);
+			}
+		} else if (strcmp(argument->key, "c") == 0 || strcmp(argument->key, "stdout") == 0) {
+			if (output_directory != NULL) {
+				fprintf(stderr, "fatal error: an output directory cannot be used with --in-place or --stdout\r\n");
+				return exit_status(EXIT_FAILURE);
+			}
+			
+			to_stdout = 1;
+			
+			// Anything already printed must come out before the reversed content
+			fflush(stdout);
+		} else if (strcmp(argument->key, "i") == 0 || strcmp(argument->key, "in-place") == 0) {
+			if (output_directory != NULL) {
+				fprintf(stderr, "fatal error: an output directory cannot be used with --in-place or --stdout\r\n");
+				return exit_status(EXIT_FAILURE);
+			}
+			
+			in_place = 1;
+		} else if (strcmp(argument->key, "journal") == 0) {
+			journal = 1;
+		} else if (strcmp(argument->key, "j") == 0 || strcmp(argument->key, "jobs") == 0) {
+			const char* const count = get_option_value(&argparser, argument);
+			
+			char* end = NULL;
+			const unsigned long int number = strtoul(count, &end, 10);
+			
+			if (*count < '0' || *count > '9' || *end != '\0' || number < 1 || number > MAX_JOBS) {
+				fprintf(stderr, "fatal error: invalid number of jobs '%s'\r\n", count);
+				return exit_status(EXIT_FAILURE);
+			}
+			
+			jobs = (unsigned int) number;
+			jobs_given = 1;
+		} else if (strcmp(argument->key, "direct") == 0) {
+			direct = 1;
+		} else if (strcmp(argument->key, "io-engine") == 0) {
+			const char* const value = get_option_value(&argparser, argument);
+			
+			if (io_engine_parse(value, &io_engine) == -1) {
+				fprintf(stderr, "fatal error: unknown I/O engine '%s'\r\n", value);
+				return exit_status(EXIT_FAILURE);
+			}
+		} else if (strcmp(argument->key, "durability") == 0) {
+			const char* const value = get_option_value(&argparser, argument);
+			
+			if (durability_parse(value, &durability) == -1) {
+				fprintf(stderr, "fatal error: unknown durability '%s'\r\n", value);
+				return exit_status(EXIT_FAILURE);
+			}
+		} else if (strcmp(argument->key, "order") == 0) {
+			const char* const value = get_option_value(&argparser, argument);
+			
+			if (file_order_parse(value, &file_order) == -1) {
+				fprintf(stderr, "fatal error: unknown order '%s'\r\n", value);
+				return exit_status(EXIT_FAILURE);
+			}
+		} else if (strcmp(argument->key, "readahead") == 0) {
+			const char* const value = get_option_value(&argparser, argument);
+			
+			if (parse_size(value, &readahead_window) == -1 || readahead_window > INT64_MAX) {
+				fprintf(stderr, "fatal error: invalid readahead window '%s'\r\n", value);
+				return exit_status(EXIT_FAILURE);
+			}
+		} else if (strcmp(argument->key, "chunk-size") == 0) {
+			const char* const value = get_option_value(&argparser, argument);
+			
+			if (parse_size(value, &chunk_size) == -1 || chunk_size == 0 || chunk_size > MAX_CHUNK_SIZE) {
+				fprintf(stderr, "fatal error: invalid chunk size '%s'\r\n", value);
+				return exit_status(EXIT_FAILURE);
+			}
+		} else if (strcmp(argument->key, "no-autotune") == 0) {
+			autotune = 0;
+		} else if (strcmp(argument->key, "memory-limit") == 0) {
+			const char* const value = get_option_value(&argparser, argument);
+			
+			if (parse_size(value, &memory_limit) == -1 || memory_limit > SIZE_MAX) {
+				fprintf(stderr, "fatal error: invalid memory limit '%s'\r\n", value);
+				return exit_status(EXIT_FAILURE);
+			}
+		} else if (*argument->key == '\0' || strcmp(argument->key, "stdin") == 0) {
+			// A lone dash stands for standard input
+			if (stdin_reverse() == -1) {
+				return exit_status(EXIT_FAILURE);
+			}
 		} else if (strcmp(argument->key, "v") == 0 || strcmp(argument->key, "version") == 0) {
 			printf("%s v%s (+%s)\n", REVF_NAME, REVF_VERSION, REVF_REPOSITORY);
-			return EXIT_SUCCESS;
+			return exit_status(EXIT_SUCCESS);
 		} else if (strcmp(argument->key, "h") == 0 || strcmp(argument->key, "help") == 0) {
 			printf("%s\n", REVF_DESCRIPTION);
-			return EXIT_SUCCESS;
+			return exit_status(EXIT_SUCCESS);
 		} else {
 			const char* const path = argument->key;
 			
@@ -253,14 +1219,35 @@ int main(int argc, argv_t* argv[]) {
 				const struct SystemError error = get_system_error();
 				fprintf(stderr, "fatal error: could not stat file at '%s': %s\n", path, error.message);
 				
-				return EXIT_FAILURE;
+				return exit_status(EXIT_FAILURE);
 			}
 			
 			switch (info.type) {
 				case FILEINFO_FILE:
 				case FILEINFO_FILE_LINK: {
-					if (file_reverse(path) == -1) {
-						return EXIT_FAILURE;
+					if (output_directory == NULL) {
+						const int skip = skip_linked_file(path, NULL);
+						
+						if (skip == -1) {
+							return exit_status(EXIT_FAILURE);
+						}
+						
+						if (skip == 0 && file_reverse(path, NULL) == -1) {
+							return exit_status(EXIT_FAILURE);
+						}
+						
+						break;
+					}
+					
+					const char* const name = basename(path);
+					
+					char destination[strlen(output_directory) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+					strcpy(destination, output_directory);
+					strcat(destination, PATH_SEPARATOR);
+					strcat(destination, name);
+					
+					if (file_reverse(path, destination) == -1) {
+						return exit_status(EXIT_FAILURE);
 					}
 					
 					break;
@@ -269,11 +1256,25 @@ int main(int argc, argv_t* argv[]) {
 				case FILEINFO_DIRECTORY_LINK: {
 					if (!recursive) {
 						fprintf(stderr, "fatal error: refusing to recurse down into directory '%s'\n", path);
-						return EXIT_FAILURE;
+						return exit_status(EXIT_FAILURE);
 					}
 					
-					if (directory_reverse(path) == -1) {
-						return EXIT_FAILURE;
+					/*
+					The io_uring engine already has many files in flight from a single thread, and
+					standard output takes files one at a time, so both walk the tree on a single
+					thread. So does --order=physical, as threads would not keep to any order.
+					*/
+					#if defined(_WIN32)
+						const int parallel = 0;
+					#else
+						const int parallel = (jobs > 1 && !to_stdout && io_engine != IO_ENGINE_URING && file_order == FILE_ORDER_DIRECTORY);
+					#endif
+					
+					// The content of the directory is mirrored into the output directory itself
+					const int status = parallel ? parallel_directory_reverse(path, output_directory) : directory_reverse(path, output_directory);
+					
+					if (status == -1) {
+						return exit_status(EXIT_FAILURE);
 					}
 					
 					break;
@@ -282,6 +1283,6 @@ int main(int argc, argv_t* argv[]) {
 		}
 	}
 	
-	return EXIT_SUCCESS;
+	return exit_status(EXIT_SUCCESS);
 	
 }
\ No newline at end of file
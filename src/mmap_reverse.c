@@ -0,0 +1,189 @@
+#include <stdlib.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+#include "mmap_reverse.h"
+#include "reverse_memcpy.h"
+
+#if !defined(_WIN32)
+
+// Amount of data mapped at once from each file; must be a multiple of the page size
+#define MMAP_WINDOW_SIZE (64 * 1024 * 1024)
+
+#if defined(MAP_POPULATE)
+	#define HAVE_MAP_POPULATE 1
+#else
+	#define MAP_POPULATE 0
+#endif
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+	#define HAVE_POSIX_FALLOCATE 1
+#endif
+
+static void close_keep_errno(const int fd) {
+	
+	const int error = errno;
+	close(fd);
+	errno = error;
+	
+}
+
+#endif
+
+int mmap_reverse(const char* const source, const char* const destination) {
+	/*
+	Writes the reversed content of source into destination through memory mappings.
+	
+	Both files are mapped in windows of a few dozen megabytes, and each window is
+	reversed directly from one mapping into the other. This avoids the intermediate
+	copies and the read()/write() calls of the stream path.
+	
+	The windows are walked in destination order, so the destination is written front
+	to back while the source is consumed back to front. Each source window is
+	populated upfront (which the kernel does with forward readahead), and the one
+	after it is requested while the current one is being reversed.
+	
+	The destination is created (or truncated) and preallocated to the size of the
+	source, so that running out of space is reported here instead of as a SIGBUS
+	in the middle of the copy.
+	
+	Sets errno to ENODEV if source is not a regular file, which is also what mmap()
+	reports for filesystems that do not support it; callers can fall back to another
+	method in that case.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) source;
+		(void) destination;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#else
+		const int input = open(source, O_RDONLY);
+		
+		if (input == -1) {
+			return -1;
+		}
+		
+		struct stat st = {0};
+		
+		if (fstat(input, &st) == -1) {
+			close_keep_errno(input);
+			return -1;
+		}
+		
+		if (!S_ISREG(st.st_mode)) {
+			close(input);
+			errno = ENODEV;
+			
+			return -1;
+		}
+		
+		const int output = open(destination, O_RDWR | O_CREAT | O_TRUNC, 0666);
+		
+		if (output == -1) {
+			close_keep_errno(input);
+			return -1;
+		}
+		
+		const off_t size = st.st_size;
+		
+		if (size > 0 && ftruncate(output, size) == -1) {
+			close_keep_errno(input);
+			close_keep_errno(output);
+			
+			return -1;
+		}
+		
+		#if defined(HAVE_POSIX_FALLOCATE)
+			if (size > 0) {
+				const int error = posix_fallocate(output, 0, size);
+				
+				// Not all filesystems support preallocation; that is not an error by itself
+				if (error != 0 && error != EINVAL && error != EOPNOTSUPP) {
+					close(input);
+					close(output);
+					
+					errno = error;
+					
+					return -1;
+				}
+			}
+		#endif
+		
+		const off_t page_size = (off_t) sysconf(_SC_PAGESIZE);
+		
+		for (off_t offset = 0; offset < size; offset += MMAP_WINDOW_SIZE) {
+			const off_t length = (size - offset < MMAP_WINDOW_SIZE) ? size - offset : MMAP_WINDOW_SIZE;
+			
+			// The source range mirrored by this destination window, expanded down to a page boundary
+			const off_t source_start = size - offset - length;
+			const off_t source_map_start = source_start - (source_start % page_size);
+			const size_t source_map_size = (size_t) (size - offset - source_map_start);
+			
+			char* const source_map = mmap(NULL, source_map_size, PROT_READ, MAP_SHARED | MAP_POPULATE, input, source_map_start);
+			
+			if (source_map == MAP_FAILED) {
+				close_keep_errno(input);
+				close_keep_errno(output);
+				
+				return -1;
+			}
+			
+			// Pages are only needed once, so let the kernel drop them early
+			madvise(source_map, source_map_size, MADV_SEQUENTIAL);
+			
+			#if !defined(HAVE_MAP_POPULATE)
+				madvise(source_map, source_map_size, MADV_WILLNEED);
+			#endif
+			
+			#if defined(POSIX_FADV_WILLNEED)
+				// Start reading the next window while this one is being reversed
+				if (source_map_start > 0) {
+					const off_t next = (source_map_start < MMAP_WINDOW_SIZE) ? 0 : source_map_start - MMAP_WINDOW_SIZE;
+					posix_fadvise(input, next, source_map_start - next, POSIX_FADV_WILLNEED);
+				}
+			#endif
+			
+			char* const destination_map = mmap(NULL, (size_t) length, PROT_READ | PROT_WRITE, MAP_SHARED, output, offset);
+			
+			if (destination_map == MAP_FAILED) {
+				munmap(source_map, source_map_size);
+				
+				close_keep_errno(input);
+				close_keep_errno(output);
+				
+				return -1;
+			}
+			
+			madvise(destination_map, (size_t) length, MADV_SEQUENTIAL);
+			
+			reverse_memcpy(destination_map, source_map + (source_start - source_map_start), (size_t) length);
+			
+			munmap(destination_map, (size_t) length);
+			munmap(source_map, source_map_size);
+		}
+		
+		close(input);
+		
+		if (close(output) == -1) {
+			return -1;
+		}
+		
+		return 0;
+	#endif
+	
+}
@@ -0,0 +1,3 @@
+int mmap_reverse(const char* const source, const char* const destination);
+
+#pragma once
@@ -1,3 +1,8 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -5,6 +10,14 @@
 	#include <windows.h>
 #endif
 
+#if !defined(_WIN32)
+	#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+	#include <sched.h>
+#endif
+
 #include "constants.h"
 #include "os.h"
 
@@ -122,3 +135,295 @@ char* get_temporary_directory(void) {
 	return temporary_directory;
 	
 }
+
+char* get_cache_directory(void) {
+	/*
+	Returns the directory where applications should keep data that can be recreated
+	at any time, such as measurements.
+	
+	On Windows, this is %LOCALAPPDATA%.
+	On macOS, this is ~/Library/Caches.
+	On other Posix based platforms, this is $XDG_CACHE_HOME, or ~/.cache if that is not set.
+	
+	Returns NULL on error, or if there is no such directory for the current user.
+	*/
+	
+	#if defined(_WIN32)
+		const char* const value = getenv("LOCALAPPDATA");
+		
+		if (value == NULL || *value == '\0') {
+			return NULL;
+		}
+		
+		char* cache_directory = malloc(strlen(value) + 1);
+		
+		if (cache_directory == NULL) {
+			return NULL;
+		}
+		
+		strcpy(cache_directory, value);
+	#else
+		#if !defined(__APPLE__)
+			const char* const value = getenv("XDG_CACHE_HOME");
+			
+			// Relative paths are invalid and must be ignored
+			if (value != NULL && *value == *PATH_SEPARATOR) {
+				char* cache_directory = malloc(strlen(value) + 1);
+				
+				if (cache_directory == NULL) {
+					return NULL;
+				}
+				
+				strcpy(cache_directory, value);
+				
+				return cache_directory;
+			}
+		#endif
+		
+		const char* const home = getenv("HOME");
+		
+		if (home == NULL || *home == '\0') {
+			return NULL;
+		}
+		
+		#if defined(__APPLE__)
+			const char* const suffix = "/Library/Caches";
+		#else
+			const char* const suffix = "/.cache";
+		#endif
+		
+		char* cache_directory = malloc(strlen(home) + strlen(suffix) + 1);
+		
+		if (cache_directory == NULL) {
+			return NULL;
+		}
+		
+		strcpy(cache_directory, home);
+		
+		// Avoid a double separator when HOME is the root directory
+		if (strcmp(cache_directory, PATH_SEPARATOR) == 0) {
+			*cache_directory = '\0';
+		}
+		
+		strcat(cache_directory, suffix);
+	#endif
+	
+	return cache_directory;
+	
+}
+
+#if defined(__linux__)
+
+static unsigned int get_cgroup_quota(const char* const directory, const int unified) {
+	/*
+	Returns the number of CPUs the CPU quota of the cgroup at directory amounts to,
+	rounded up, or (0) if it has no quota.
+	*/
+	
+	char path[strlen(directory) + 32];
+	
+	long long int quota = 0;
+	long long int period = 0;
+	
+	if (unified) {
+		// cpu.max holds "<quota> <period>", where the quota may be "max"
+		snprintf(path, sizeof(path), "%s/cpu.max", directory);
+		
+		FILE* const file = fopen(path, "r");
+		
+		if (file == NULL) {
+			return 0;
+		}
+		
+		char value[32] = "";
+		
+		const int count = fscanf(file, "%31s %lld", value, &period);
+		
+		fclose(file);
+		
+		if (count != 2 || strcmp(value, "max") == 0) {
+			return 0;
+		}
+		
+		quota = strtoll(value, NULL, 10);
+	} else {
+		snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", directory);
+		
+		FILE* file = fopen(path, "r");
+		
+		if (file == NULL) {
+			return 0;
+		}
+		
+		const int count = fscanf(file, "%lld", &quota);
+		
+		fclose(file);
+		
+		// A quota of -1 means there is none
+		if (count != 1 || quota <= 0) {
+			return 0;
+		}
+		
+		snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", directory);
+		
+		file = fopen(path, "r");
+		
+		if (file == NULL) {
+			return 0;
+		}
+		
+		if (fscanf(file, "%lld", &period) != 1) {
+			period = 0;
+		}
+		
+		fclose(file);
+	}
+	
+	if (quota <= 0 || period <= 0) {
+		return 0;
+	}
+	
+	return (unsigned int) ((quota + period - 1) / period);
+	
+}
+
+static unsigned int get_cgroup_cpu_limit(void) {
+	/*
+	Returns the number of CPUs the process may use as far as its cgroup is concerned,
+	or (0) if there is no limit.
+	
+	Both the unified hierarchy (cgroup v2) and the legacy cpu controller (cgroup v1)
+	are looked up. Every level of the hierarchy may set a quota of its own, and the
+	lowest one applies.
+	*/
+	
+	FILE* const file = fopen("/proc/self/cgroup", "r");
+	
+	if (file == NULL) {
+		return 0;
+	}
+	
+	unsigned int limit = 0;
+	
+	char line[4096];
+	
+	while (fgets(line, sizeof(line), file) != NULL) {
+		// Each line is "<id>:<controllers>:<path>"; the unified hierarchy has no controllers
+		char* const controllers = strchr(line, ':');
+		
+		if (controllers == NULL) {
+			continue;
+		}
+		
+		char* const group = strchr(controllers + 1, ':');
+		
+		if (group == NULL) {
+			continue;
+		}
+		
+		*group = '\0';
+		group[strcspn(group + 1, "\n") + 1] = '\0';
+		
+		const int unified = (controllers[1] == '\0');
+		
+		if (!unified) {
+			int has_cpu = 0;
+			
+			for (char* name = controllers + 1; name != NULL; name = strchr(name, ',')) {
+				if (*name == ',') {
+					name++;
+				}
+				
+				if (strncmp(name, "cpu", 3) == 0 && (name[3] == ',' || name[3] == '\0')) {
+					has_cpu = 1;
+					break;
+				}
+			}
+			
+			if (!has_cpu) {
+				continue;
+			}
+		}
+		
+		const char* const root = unified ? "/sys/fs/cgroup" : "/sys/fs/cgroup/cpu";
+		
+		char directory[strlen(root) + strlen(group + 1) + 1];
+		strcpy(directory, root);
+		
+		// The root group itself is "/"
+		if (strcmp(group + 1, "/") != 0) {
+			strcat(directory, group + 1);
+		}
+		
+		while (1) {
+			const unsigned int quota = get_cgroup_quota(directory, unified);
+			
+			if (quota > 0 && (limit == 0 || quota < limit)) {
+				limit = quota;
+			}
+			
+			if (strlen(directory) <= strlen(root)) {
+				break;
+			}
+			
+			*strrchr(directory, '/') = '\0';
+		}
+	}
+	
+	fclose(file);
+	
+	return limit;
+	
+}
+
+#endif
+
+unsigned int get_cpu_count(void) {
+	/*
+	Returns the number of CPUs the process can actually keep busy: those it is allowed
+	to run on, as further limited by the CPU quota of its cgroup on Linux, so that
+	containers are not flooded with threads they have no time for.
+	
+	Returns (1) if the count cannot be known.
+	*/
+	
+	long int count = 0;
+	
+	#if defined(_WIN32)
+		DWORD_PTR process_mask = 0;
+		DWORD_PTR system_mask = 0;
+		
+		if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask) != 0) {
+			for (; process_mask != 0; process_mask &= process_mask - 1) {
+				count++;
+			}
+		}
+		
+		if (count == 0) {
+			SYSTEM_INFO info = {0};
+			GetSystemInfo(&info);
+			
+			count = (long int) info.dwNumberOfProcessors;
+		}
+	#else
+		count = sysconf(_SC_NPROCESSORS_ONLN);
+		
+		#if defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			
+			if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+				count = CPU_COUNT(&set);
+			}
+			
+			const unsigned int limit = get_cgroup_cpu_limit();
+			
+			if (limit > 0 && (long int) limit < count) {
+				count = (long int) limit;
+			}
+		#endif
+	#endif
+	
+	return (count < 1) ? 1 : (unsigned int) count;
+	
+}
@@ -1,3 +1,5 @@
 char* get_temporary_directory(void);
+char* get_cache_directory(void);
+unsigned int get_cpu_count(void);
 
 #pragma once
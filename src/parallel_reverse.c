@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <pthread.h>
+	#include <sys/stat.h>
+#endif
+
+#include "parallel_reverse.h"
+#include "reverse_memcpy.h"
+
+#if !defined(_WIN32)
+
+// Amount of data each worker reads and writes at once; segment boundaries are aligned to it
+#define PARALLEL_CHUNK_SIZE (1024 * 1024)
+
+// Segments smaller than this are not worth a thread of their own
+#define PARALLEL_MIN_SEGMENT_SIZE (16 * 1024 * 1024)
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+	#define HAVE_POSIX_FALLOCATE 1
+#endif
+
+struct ParallelReverse {
+	int input;
+	int output;
+	off_t size;
+	int error;
+	pthread_mutex_t mutex;
+};
+
+struct ParallelReverseWorker {
+	struct ParallelReverse* shared;
+	off_t start;
+	off_t end;
+	pthread_t thread;
+};
+
+static int has_failed(struct ParallelReverse* const shared) {
+	
+	pthread_mutex_lock(&shared->mutex);
+	const int error = shared->error;
+	pthread_mutex_unlock(&shared->mutex);
+	
+	return error != 0;
+	
+}
+
+static void set_failed(struct ParallelReverse* const shared, const int error) {
+	
+	pthread_mutex_lock(&shared->mutex);
+	
+	if (shared->error == 0) {
+		shared->error = error;
+	}
+	
+	pthread_mutex_unlock(&shared->mutex);
+	
+}
+
+static int transfer(const int fd, char* const buffer, const size_t size, const off_t offset, const int write) {
+	/*
+	Reads or writes a whole buffer at the given offset.
+	
+	Returns (0) on success, or the error number on error.
+	*/
+	
+	size_t position = 0;
+	
+	while (position < size) {
+		const ssize_t result = write ?
+			pwrite(fd, buffer + position, size - position, offset + (off_t) position) :
+			pread(fd, buffer + position, size - position, offset + (off_t) position);
+		
+		if (result == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return errno;
+		}
+		
+		// The file was truncated while it was being read
+		if (result == 0) {
+			return EIO;
+		}
+		
+		position += (size_t) result;
+	}
+	
+	return 0;
+	
+}
+
+static void* reverse_segment(void* const argument) {
+	/*
+	Reverses one segment of the source into its mirrored range of the destination.
+	
+	The segment is read from its end towards its start, so that the destination is
+	written front to back; the data needed next is requested while the current chunk
+	is being processed.
+	*/
+	
+	struct ParallelReverseWorker* const worker = argument;
+	struct ParallelReverse* const shared = worker->shared;
+	
+	char* const buffer = malloc(PARALLEL_CHUNK_SIZE * 2);
+	
+	if (buffer == NULL) {
+		set_failed(shared, ENOMEM);
+		return NULL;
+	}
+	
+	char* const reverse_buffer = buffer + PARALLEL_CHUNK_SIZE;
+	
+	off_t end = worker->end;
+	
+	while (end > worker->start && !has_failed(shared)) {
+		const off_t start = (end - worker->start > PARALLEL_CHUNK_SIZE) ? end - PARALLEL_CHUNK_SIZE : worker->start;
+		const size_t length = (size_t) (end - start);
+		
+		#if defined(POSIX_FADV_WILLNEED)
+			if (start > worker->start) {
+				const off_t next = (start - worker->start > PARALLEL_CHUNK_SIZE) ? start - PARALLEL_CHUNK_SIZE : worker->start;
+				posix_fadvise(shared->input, next, start - next, POSIX_FADV_WILLNEED);
+			}
+		#endif
+		
+		int error = transfer(shared->input, buffer, length, start, 0);
+		
+		if (error == 0) {
+			reverse_memcpy(reverse_buffer, buffer, length);
+			error = transfer(shared->output, reverse_buffer, length, shared->size - end, 1);
+		}
+		
+		if (error != 0) {
+			set_failed(shared, error);
+			break;
+		}
+		
+		end = start;
+	}
+	
+	free(buffer);
+	
+	return NULL;
+	
+}
+
+#endif
+
+int parallel_reverse(const char* const source, const char* const destination, const unsigned int threads) {
+	/*
+	Writes the reversed content of source into destination using several threads.
+	
+	The source is split into contiguous segments, one per thread. Each thread reverses
+	its own segment and writes it at the mirrored offset (size - end) of the destination,
+	which is preallocated upfront so that the threads never extend it concurrently.
+	
+	Fewer threads than requested are used if the file is too small for all of them to
+	get a segment worth the cost.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) source;
+		(void) destination;
+		(void) threads;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#else
+		struct ParallelReverse shared = {
+			.input = -1,
+			.output = -1,
+			.size = 0,
+			.error = 0
+		};
+		
+		shared.input = open(source, O_RDONLY);
+		
+		if (shared.input == -1) {
+			return -1;
+		}
+		
+		struct stat st = {0};
+		
+		if (fstat(shared.input, &st) == -1) {
+			const int error = errno;
+			close(shared.input);
+			
+			errno = error;
+			
+			return -1;
+		}
+		
+		shared.size = st.st_size;
+		
+		shared.output = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		
+		if (shared.output == -1) {
+			const int error = errno;
+			close(shared.input);
+			
+			errno = error;
+			
+			return -1;
+		}
+		
+		int error = 0;
+		
+		if (shared.size > 0 && ftruncate(shared.output, shared.size) == -1) {
+			error = errno;
+		}
+		
+		#if defined(HAVE_POSIX_FALLOCATE)
+			if (error == 0 && shared.size > 0) {
+				error = posix_fallocate(shared.output, 0, shared.size);
+				
+				// Not all filesystems support preallocation; that is not an error by itself
+				if (error == EINVAL || error == EOPNOTSUPP) {
+					error = 0;
+				}
+			}
+		#endif
+		
+		// Each thread reads its segment backwards; the kernel's forward readahead would only get in the way
+		#if defined(POSIX_FADV_RANDOM)
+			posix_fadvise(shared.input, 0, 0, POSIX_FADV_RANDOM);
+		#endif
+		
+		uint64_t count = (uint64_t) shared.size / PARALLEL_MIN_SEGMENT_SIZE;
+		
+		if (count > threads) {
+			count = threads;
+		}
+		
+		if (count == 0) {
+			count = 1;
+		}
+		
+		struct ParallelReverseWorker* const workers = calloc((size_t) count, sizeof(*workers));
+		
+		if (error == 0 && workers == NULL) {
+			error = ENOMEM;
+		}
+		
+		if (error == 0 && pthread_mutex_init(&shared.mutex, NULL) != 0) {
+			error = ENOMEM;
+		}
+		
+		if (error != 0) {
+			free(workers);
+			
+			close(shared.input);
+			close(shared.output);
+			
+			errno = error;
+			
+			return -1;
+		}
+		
+		// Segment boundaries fall on chunk boundaries, so that every read and write but the last ones are whole chunks
+		const uint64_t chunks = ((uint64_t) shared.size + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+		
+		uint64_t started = 0;
+		
+		for (uint64_t index = 0; index < count; index++) {
+			struct ParallelReverseWorker* const worker = &workers[index];
+			
+			worker->shared = &shared;
+			worker->start = (off_t) ((chunks * index / count) * PARALLEL_CHUNK_SIZE);
+			worker->end = (index + 1 == count) ? shared.size : (off_t) ((chunks * (index + 1) / count) * PARALLEL_CHUNK_SIZE);
+			
+			// The calling thread takes care of the last segment itself
+			if (index + 1 == count) {
+				break;
+			}
+			
+			const int status = pthread_create(&worker->thread, NULL, reverse_segment, worker);
+			
+			if (status != 0) {
+				set_failed(&shared, status);
+				break;
+			}
+			
+			started++;
+		}
+		
+		if (started + 1 == count) {
+			reverse_segment(&workers[count - 1]);
+		}
+		
+		for (uint64_t index = 0; index < started; index++) {
+			pthread_join(workers[index].thread, NULL);
+		}
+		
+		pthread_mutex_destroy(&shared.mutex);
+		free(workers);
+		
+		error = shared.error;
+		
+		close(shared.input);
+		
+		if (close(shared.output) == -1 && error == 0) {
+			error = errno;
+		}
+		
+		if (error != 0) {
+			errno = error;
+			return -1;
+		}
+		
+		return 0;
+	#endif
+	
+}
@@ -0,0 +1,3 @@
+int parallel_reverse(const char* const source, const char* const destination, const unsigned int threads);
+
+#pragma once
@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+#endif
+
+#if defined(__linux__)
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/ioctl.h>
+	#include <linux/fs.h>
+	#include <linux/fiemap.h>
+#endif
+
+#include "physical_order.h"
+#include "fileinfo.h"
+
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+	#define HAVE_FIEMAP 1
+#endif
+
+#if defined(HAVE_FIEMAP)
+
+static int get_first_extent(const char* const filename, unsigned long long* const offset) {
+	/*
+	Looks up where the data of a file starts on its device. Files without any data,
+	or whose data was not placed yet, have no such offset.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	
+	if (fd == -1) {
+		return -1;
+	}
+	
+	// A single extent is all it takes, so the kernel stops looking after the first one
+	struct {
+		struct fiemap fiemap;
+		struct fiemap_extent extents[1];
+	} map = {0};
+	
+	map.fiemap.fm_start = 0;
+	map.fiemap.fm_length = FIEMAP_MAX_OFFSET;
+	map.fiemap.fm_extent_count = 1;
+	
+	const int status = ioctl(fd, FS_IOC_FIEMAP, &map.fiemap);
+	
+	const int error = errno;
+	close(fd);
+	errno = error;
+	
+	if (status == -1) {
+		return -1;
+	}
+	
+	const struct fiemap_extent* const extent = &map.fiemap.fm_extents[0];
+	
+	if (map.fiemap.fm_mapped_extents == 0 || (extent->fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC)) != 0) {
+		errno = ENODATA;
+		return -1;
+	}
+	
+	*offset = (unsigned long long) extent->fe_physical;
+	
+	return 0;
+	
+}
+
+#endif
+
+static char* copy_string(const char* const string) {
+	
+	char* const copy = malloc(strlen(string) + 1);
+	
+	if (copy == NULL) {
+		return NULL;
+	}
+	
+	strcpy(copy, string);
+	
+	return copy;
+	
+}
+
+int physical_order_add(struct PhysicalOrder* const order, const char* const source, const char* const destination) {
+	/*
+	Adds a file to the batch, looking up where its data lies right away.
+	
+	The physical offset of the first extent comes from FIEMAP on Linux. Where it is
+	not available, the file ID is used instead, as filesystems tend to allocate data
+	in the same order as inodes. Files that cannot be looked up at all still join the
+	batch, so that the error is reported once they are reversed.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (order->count == order->capacity) {
+		const size_t capacity = (order->capacity == 0) ? 64 : order->capacity * 2;
+		struct PhysicalOrderItem* const items = realloc(order->items, capacity * sizeof(*items));
+		
+		if (items == NULL) {
+			#if defined(_WIN32)
+				SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			#else
+				errno = ENOMEM;
+			#endif
+			
+			return -1;
+		}
+		
+		order->items = items;
+		order->capacity = capacity;
+	}
+	
+	struct PhysicalOrderItem item = {
+		.source = copy_string(source),
+		.destination = (destination == NULL) ? NULL : copy_string(destination),
+		.located = 0,
+		.key = 0
+	};
+	
+	if (item.source == NULL || (destination != NULL && item.destination == NULL)) {
+		free(item.source);
+		free(item.destination);
+		
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	#if defined(HAVE_FIEMAP)
+		item.located = (get_first_extent(source, &item.key) == 0);
+	#endif
+	
+	if (!item.located) {
+		struct FileInfo info = {0};
+		
+		if (get_file_info(&info, source) == 0) {
+			item.key = info.id.file;
+		}
+	}
+	
+	order->items[order->count++] = item;
+	
+	return 0;
+	
+}
+
+static int compare_items(const void* const a, const void* const b) {
+	
+	const struct PhysicalOrderItem* const x = a;
+	const struct PhysicalOrderItem* const y = b;
+	
+	// Offsets and file IDs cannot be compared with each other; files with an offset go first
+	if (x->located != y->located) {
+		return x->located ? -1 : 1;
+	}
+	
+	if (x->key != y->key) {
+		return (x->key < y->key) ? -1 : 1;
+	}
+	
+	return 0;
+	
+}
+
+void physical_order_sort(struct PhysicalOrder* const order) {
+	
+	if (order->count > 1) {
+		qsort(order->items, order->count, sizeof(*order->items), compare_items);
+	}
+	
+}
+
+void physical_order_clear(struct PhysicalOrder* const order) {
+	
+	for (size_t index = 0; index < order->count; index++) {
+		free(order->items[index].source);
+		free(order->items[index].destination);
+	}
+	
+	order->count = 0;
+	
+}
+
+void physical_order_free(struct PhysicalOrder* const order) {
+	
+	physical_order_clear(order);
+	free(order->items);
+	
+	memset(order, 0, sizeof(*order));
+	
+}
@@ -0,0 +1,31 @@
+#include <stdlib.h>
+
+// Number of files collected before they are sorted and reversed
+#define PHYSICAL_ORDER_SIZE 4096
+
+/*
+A file waiting to be reversed. located tells whether key is the physical offset of
+its first extent on the device, or, failing that, its file ID.
+*/
+struct PhysicalOrderItem {
+	char* source;
+	char* destination;
+	int located;
+	unsigned long long key;
+};
+
+/*
+Batch of files to be reversed in the order their data is laid out on the device.
+*/
+struct PhysicalOrder {
+	struct PhysicalOrderItem* items;
+	size_t count;
+	size_t capacity;
+};
+
+int physical_order_add(struct PhysicalOrder* const order, const char* const source, const char* const destination);
+void physical_order_sort(struct PhysicalOrder* const order);
+void physical_order_clear(struct PhysicalOrder* const order);
+void physical_order_free(struct PhysicalOrder* const order);
+
+#pragma once
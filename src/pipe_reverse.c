@@ -0,0 +1,346 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#include "pipe_reverse.h"
+#include "constants.h"
+#include "reverse_memcpy.h"
+
+#if !defined(_WIN32)
+
+// Size of each block of the chain input is buffered in
+#define PIPE_BLOCK_SIZE (4 * 1024 * 1024)
+
+struct PipeReverse {
+	char** blocks;
+	size_t capacity;
+	size_t first;
+	size_t count;
+	size_t last_size;
+	const char* temporary_directory;
+	int spill;
+	off_t spilled;
+};
+
+static int write_all(const int fd, const char* const buffer, const size_t size) {
+	
+	size_t done = 0;
+	
+	while (done < size) {
+		const ssize_t wsize = write(fd, buffer + done, size - done);
+		
+		if (wsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		done += (size_t) wsize;
+	}
+	
+	return 0;
+	
+}
+
+static int open_spill_file(const char* const directory) {
+	/*
+	Creates a file in directory that has no name, so that it goes away with the process
+	no matter how it exits.
+	
+	Returns the file descriptor, or (-1) on error.
+	*/
+	
+	#if defined(O_TMPFILE)
+		const int anonymous = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+		
+		// Only fall back to a named file if the filesystem does not support anonymous ones
+		if (anonymous != -1 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)) {
+			return anonymous;
+		}
+	#endif
+	
+	const char* const name = "revf-XXXXXX";
+	
+	char path[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+	
+	strcpy(path, directory);
+	strcat(path, PATH_SEPARATOR);
+	strcat(path, name);
+	
+	const int fd = mkstemp(path);
+	
+	if (fd == -1) {
+		return -1;
+	}
+	
+	if (unlink(path) == -1) {
+		const int error = errno;
+		close(fd);
+		
+		errno = error;
+		
+		return -1;
+	}
+	
+	return fd;
+	
+}
+
+static int spill_block(struct PipeReverse* const chain) {
+	/*
+	Moves the oldest block in memory to the end of the spill file, which thus always
+	holds the start of the input.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (chain->spill == -1) {
+		chain->spill = open_spill_file(chain->temporary_directory);
+		
+		if (chain->spill == -1) {
+			return -1;
+		}
+	}
+	
+	const char* const block = chain->blocks[chain->first];
+	
+	size_t done = 0;
+	
+	while (done < PIPE_BLOCK_SIZE) {
+		const ssize_t wsize = pwrite(chain->spill, block + done, PIPE_BLOCK_SIZE - done, chain->spilled + (off_t) done);
+		
+		if (wsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		done += (size_t) wsize;
+	}
+	
+	chain->spilled += PIPE_BLOCK_SIZE;
+	
+	chain->first = (chain->first + 1) % chain->capacity;
+	chain->count--;
+	
+	return 0;
+	
+}
+
+static char* next_block(struct PipeReverse* const chain) {
+	/*
+	Makes room for one more block at the end of the chain, spilling the oldest one to
+	disk if the memory budget is used up.
+	
+	Returns the new block, or a null pointer on error.
+	*/
+	
+	if (chain->count == chain->capacity && spill_block(chain) == -1) {
+		return NULL;
+	}
+	
+	const size_t index = (chain->first + chain->count) % chain->capacity;
+	
+	// Blocks are only allocated once, and then reused for as long as input keeps coming
+	if (chain->blocks[index] == NULL) {
+		chain->blocks[index] = malloc(PIPE_BLOCK_SIZE);
+		
+		if (chain->blocks[index] == NULL) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+	
+	chain->count++;
+	chain->last_size = 0;
+	
+	return chain->blocks[index];
+	
+}
+
+static int buffer_input(struct PipeReverse* const chain, const int input) {
+	/*
+	Reads input until its end into the chain of blocks.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	char* block = NULL;
+	
+	while (1) {
+		if (block == NULL || chain->last_size == PIPE_BLOCK_SIZE) {
+			block = next_block(chain);
+			
+			if (block == NULL) {
+				return -1;
+			}
+		}
+		
+		const ssize_t rsize = read(input, block + chain->last_size, PIPE_BLOCK_SIZE - chain->last_size);
+		
+		if (rsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		if (rsize == 0) {
+			break;
+		}
+		
+		chain->last_size += (size_t) rsize;
+	}
+	
+	return 0;
+	
+}
+
+static int emit_output(struct PipeReverse* const chain, const int output) {
+	/*
+	Writes the blocks in memory from the newest to the oldest, each one reversed, and
+	then the spill file read backwards.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	for (size_t index = chain->count; index > 0; index--) {
+		char* const block = chain->blocks[(chain->first + index - 1) % chain->capacity];
+		const size_t size = (index == chain->count) ? chain->last_size : PIPE_BLOCK_SIZE;
+		
+		reverse_inplace(block, size);
+		
+		if (write_all(output, block, size) == -1) {
+			return -1;
+		}
+	}
+	
+	if (chain->spilled == 0) {
+		return 0;
+	}
+	
+	// The spill file only ever gets whole blocks, and there is always one block in memory to read them into
+	char* const block = chain->blocks[chain->first];
+	
+	for (off_t offset = chain->spilled; offset > 0; offset -= PIPE_BLOCK_SIZE) {
+		size_t done = 0;
+		
+		while (done < PIPE_BLOCK_SIZE) {
+			const ssize_t rsize = pread(chain->spill, block + done, PIPE_BLOCK_SIZE - done, offset - PIPE_BLOCK_SIZE + (off_t) done);
+			
+			if (rsize == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				
+				return -1;
+			}
+			
+			if (rsize == 0) {
+				errno = EIO;
+				return -1;
+			}
+			
+			done += (size_t) rsize;
+		}
+		
+		reverse_inplace(block, PIPE_BLOCK_SIZE);
+		
+		if (write_all(output, block, PIPE_BLOCK_SIZE) == -1) {
+			return -1;
+		}
+	}
+	
+	return 0;
+	
+}
+
+#endif
+
+int pipe_reverse(const int input, const int output, const uint64_t memory_limit, const char* const temporary_directory) {
+	/*
+	Reads input until its end, and writes its content reversed to output. Neither needs
+	to be seekable, so this works with pipes and terminals.
+	
+	Nothing can be written before the whole input was read, so input is buffered in a
+	chain of large blocks. Once the blocks take up memory_limit bytes, the oldest ones
+	are moved to an unlinked file in temporary_directory; those hold the start of the
+	input, which is written last, so the blocks still in memory are written first, and
+	the file is read backwards afterwards. Input of any size can thus be reversed within
+	a fixed amount of memory, rounded up to a whole block.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) input;
+		(void) output;
+		(void) memory_limit;
+		(void) temporary_directory;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#else
+		struct PipeReverse chain = {
+			.capacity = (size_t) ((memory_limit + PIPE_BLOCK_SIZE - 1) / PIPE_BLOCK_SIZE),
+			.temporary_directory = temporary_directory,
+			.spill = -1
+		};
+		
+		if (chain.capacity == 0) {
+			chain.capacity = 1;
+		}
+		
+		chain.blocks = calloc(chain.capacity, sizeof(*chain.blocks));
+		
+		if (chain.blocks == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		
+		int status = buffer_input(&chain, input);
+		
+		if (status == 0) {
+			status = emit_output(&chain, output);
+		}
+		
+		const int error = errno;
+		
+		for (size_t index = 0; index < chain.capacity; index++) {
+			free(chain.blocks[index]);
+		}
+		
+		free(chain.blocks);
+		
+		if (chain.spill != -1) {
+			close(chain.spill);
+		}
+		
+		errno = error;
+		
+		return status;
+	#endif
+	
+}
@@ -0,0 +1,5 @@
+#include <stdint.h>
+
+int pipe_reverse(const int input, const int output, const uint64_t memory_limit, const char* const temporary_directory);
+
+#pragma once
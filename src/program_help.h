@@ -3,13 +3,29 @@ This file is auto-generated. Use the ../tools/program_help.h.py tool to regenera
 */
 
 #define PROGRAM_HELP \
-	"usage: revf [-h] [-v] [-r]\n" \
+	"usage: revf [-h] [-v] [-r] [-x] [-c] [-o DIR] [-i] [--journal] [-j N] [--direct] [--durability MODE] [--order ORDER] [--io-engine ENGINE] [--readahead SIZE] [--chunk-size SIZE] [--no-autotune] [--stdin] [--memory-limit SIZE]\n" \
 	"\n" \
 	"Reverse the content of files.\n" \
 	"\n" \
 	"options:\n" \
-	"  -h, --help       Show this help message and exit.\n" \
-	"  -v, --version    Display the revf version and exit.\n" \
-	"  -r, --recursive  Recurse down into directories.\n" \
+	"  -h, --help            Show this help message and exit.\n" \
+	"  -v, --version         Display the revf version and exit.\n" \
+	"  -r, --recursive       Recurse down into directories. Symbolic links below the directories given are not followed, and a directory reached more than once, through a bind mount or by being given twice, is only walked the first time.\n" \
+	"  -x, --one-file-system\n" \
+	"                        With -r, skip directories on other filesystems than the directory given, such as mount points.\n" \
+	"  -c, --stdout          Write the reversed content of files to standard output, leaving the files themselves untouched.\n" \
+	"  -o DIR, --output DIR  Write reversed files to DIR instead of replacing them, leaving the files themselves untouched. With -r, the content of each directory is recreated under DIR.\n" \
+	"  -i, --in-place        Reverse files in place, without writing a temporary copy of them. A file with several hard links is only reversed once, through the first link met; the other links are reported and skipped.\n" \
+	"  --journal             With --in-place, keep an undo journal next to each file so that an interrupted run can be resumed.\n" \
+	"  -j N, --jobs N        Number of threads to use (default: the number of CPUs revf may run on, as limited by its CPU affinity and cgroup CPU quota). With -r, N threads walk directories and reverse their files at the same time, taking work from each other whenever they run out. Each file is then reversed by a single thread, with the same engine and settings as with -j 1; --io-engine=uring, --stdout and --order=physical always walk on a single thread. Otherwise, when -j is given and neither --io-engine nor a measured profile chose an engine, files of 64 MiB and more are split into N segments, reversed at the same time.\n" \
+	"  --direct              Bypass the page cache with direct I/O, so that reversing huge files does not evict everything else from memory. Files on filesystems without direct I/O support are reversed normally.\n" \
+	"  --durability MODE     How reversed files are made to survive a crash or power loss: none, batch or file (default: none). none leaves it all to the operating system. With batch, the data of every 64 files is synced at once, with a single flush of their filesystem, and only then do they replace the originals, so that a crash never leaves an empty or partial file behind. Until then, the originals stay in place: a file given more than once is reversed from its original each time, and an interrupted run leaves up to 63 files unreversed. file syncs each file and its directory on its own, which is much slower with many small files. With --io-engine=uring, batch and file both sync each file before it replaces its original, with the flushes of many files in flight at once instead of batches; file also syncs the directory afterwards.\n" \
+	"  --order ORDER         Order in which the files of a directory tree are reversed with -r: directory or physical (default: directory). directory follows the order of the directory entries. physical collects up to 4096 files at a time and reverses them in the order their data is laid out on the device, as told by FIEMAP on Linux, or by their file IDs elsewhere, which avoids seeking back and forth on hard disks. It implies -j 1 for directory trees.\n" \
+	"  --io-engine ENGINE    Method used to read and write file contents: auto, stream, mmap or uring (default: auto). With auto, large regular files are reversed through memory mappings. uring reverses many files at once through io_uring on Linux, and falls back to auto where it is not available.\n" \
+	"  --readahead SIZE      Amount of data to request ahead of the backward reads of the stream engine, with an optional K, M or G suffix (default: 8M). 0 leaves readahead to the operating system.\n" \
+	"  --chunk-size SIZE     Size of the blocks read and written by the stream engine, with an optional K, M or G suffix. By default, it is measured for each device along with the best engine, see --no-autotune.\n" \
+	"  --no-autotune         Do not measure devices. Otherwise, the first file of 40 MiB or more reversed on a device is used to find the chunk size and engine that work best for it, and the results are saved to revf.profile in the cache directory of the user for later runs. Settings given on the command line always take precedence.\n" \
+	"  --stdin               Write the reversed content of standard input to standard output. A lone - does the same.\n" \
+	"  --memory-limit SIZE   Amount of memory used to buffer standard input with --stdin, with an optional K, M or G suffix (default: 256M). Any input beyond that is kept in a temporary file.\n" \
 
 #pragma once
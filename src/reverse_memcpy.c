@@ -1,8 +1,190 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "reverse_memcpy.h"
+#include "reverse_memcpy_vector.h"
+#include "reverse_memcpy_x86.h"
 
-char* reverse_memcpy(char* const destination, const char* const source, const size_t num) {
+// Used when the size of the last level cache cannot be determined
+#define DEFAULT_NON_TEMPORAL_THRESHOLD (8 * 1024 * 1024)
+
+// Size of the blocks swapped between both ends of the buffer by reverse_inplace()
+#define INPLACE_BLOCK_SIZE 4096
+
+// Four times the widest vector (AVX-512), plus some odd sizes past it
+#define VERIFY_MAX_SIZE (4 * 64 + 17)
+
+static struct ReverseMemcpyKernel kernels[] = {
+	{"scalar", reverse_memcpy_scalar, 0, 1},
+#if defined(HAVE_VECTOR_KERNEL)
+	{"vector", reverse_memcpy_vector, 0, 1},
+#endif
+#if defined(HAVE_X86_SIMD_KERNELS)
+	{"ssse3", reverse_memcpy_ssse3, 0, 0},
+	{"ssse3-nt", reverse_memcpy_ssse3_nt, 1, 0},
+	{"avx2", reverse_memcpy_avx2, 0, 0},
+	{"avx2-nt", reverse_memcpy_avx2_nt, 1, 0},
+	{"avx512vbmi", reverse_memcpy_avx512vbmi, 0, 0},
+	{"avx512vbmi-nt", reverse_memcpy_avx512vbmi_nt, 1, 0},
+#endif
+};
+
+static const struct ReverseMemcpyKernel* kernel = NULL;
+static const struct ReverseMemcpyKernel* kernel_non_temporal = NULL;
+
+static size_t non_temporal_threshold = 0;
+
+void reverse_memcpy_init(void) {
+	/*
+	Probes the CPU and selects the fastest available kernel.
+	
+	The kernels are listed from the slowest to the fastest, so the last available
+	one wins. Buffers larger than the last level cache are routed to the matching
+	non-temporal variant, if there is one, so that they do not evict the cache.
+	
+	Every kernel is checked against the scalar version before it is considered,
+	and the ones that disagree with it are marked as unavailable.
+	
+	The "REVF_KERNEL" environment variable forces a specific kernel by name, which
+	allows exercising e.g. the portable vector kernel on x86 machines.
+	
+	This is called implicitly by the first reverse_memcpy() call, but callers that
+	are going to use it from multiple threads should call it upfront.
+	*/
+	
+	if (kernel != NULL) {
+		return;
+	}
+	
+	non_temporal_threshold = DEFAULT_NON_TEMPORAL_THRESHOLD;
+	
+	#if defined(HAVE_X86_SIMD_KERNELS)
+		for (size_t index = 0; index < (sizeof(kernels) / sizeof(*kernels)); index++) {
+			struct ReverseMemcpyKernel* const item = &kernels[index];
+			
+			if (item->function == reverse_memcpy_ssse3 || item->function == reverse_memcpy_ssse3_nt) {
+				item->available = x86_has_feature(X86_FEATURE_SSSE3);
+			} else if (item->function == reverse_memcpy_avx2 || item->function == reverse_memcpy_avx2_nt) {
+				item->available = x86_has_feature(X86_FEATURE_AVX2);
+			} else if (item->function == reverse_memcpy_avx512vbmi || item->function == reverse_memcpy_avx512vbmi_nt) {
+				item->available = x86_has_feature(X86_FEATURE_AVX512VBMI);
+			}
+		}
+		
+		const size_t cache_size = x86_last_level_cache_size();
+		
+		if (cache_size != 0) {
+			non_temporal_threshold = cache_size;
+		}
+	#endif
+	
+	for (size_t index = 1; index < (sizeof(kernels) / sizeof(*kernels)); index++) {
+		struct ReverseMemcpyKernel* const item = &kernels[index];
+		
+		if (item->available && !reverse_memcpy_verify(item->function)) {
+			item->available = 0;
+		}
+	}
+	
+	const char* const name = getenv("REVF_KERNEL");
+	
+	const struct ReverseMemcpyKernel* selected = NULL;
+	const struct ReverseMemcpyKernel* selected_non_temporal = NULL;
+	
+	for (size_t index = 0; index < (sizeof(kernels) / sizeof(*kernels)); index++) {
+		const struct ReverseMemcpyKernel* const item = &kernels[index];
+		
+		if (!item->available) {
+			continue;
+		}
+		
+		if (name != NULL && *name != '\0') {
+			if (strcmp(item->name, name) == 0) {
+				selected = item;
+				selected_non_temporal = NULL;
+				break;
+			}
+			
+			continue;
+		}
+		
+		if (item->non_temporal) {
+			selected_non_temporal = item;
+		} else {
+			selected = item;
+			selected_non_temporal = NULL;
+		}
+	}
+	
+	// Unknown or unavailable forced kernel
+	if (selected == NULL) {
+		selected = &kernels[0];
+	}
+	
+	kernel_non_temporal = selected_non_temporal;
+	kernel = selected;
+	
+}
+
+const struct ReverseMemcpyKernel* reverse_memcpy_kernels(size_t* const count) {
+	/*
+	Returns all kernels compiled into the binary, including the ones the current
+	CPU cannot run (their "available" field is zero).
+	*/
+	
+	reverse_memcpy_init();
+	
+	*count = sizeof(kernels) / sizeof(*kernels);
+	
+	return kernels;
+	
+}
+
+const struct ReverseMemcpyKernel* reverse_memcpy_selected(void) {
+	
+	reverse_memcpy_init();
+	
+	return kernel;
+	
+}
+
+int reverse_memcpy_verify(const reverse_memcpy_t function) {
+	/*
+	Checks a kernel against the scalar version, for every size up to a few times the
+	widest vector and for every source and destination misalignment within 8 bytes.
+	
+	Returns (1) if the results match, (0) otherwise.
+	*/
+	
+	char source[VERIFY_MAX_SIZE + 8];
+	char expected[VERIFY_MAX_SIZE + 8];
+	char destination[VERIFY_MAX_SIZE + 8 + 1];
+	
+	for (size_t index = 0; index < sizeof(source); index++) {
+		source[index] = (char) (index * 7 + 3);
+	}
+	
+	for (size_t size = 0; size <= VERIFY_MAX_SIZE; size++) {
+		for (size_t alignment = 0; alignment < 8; alignment++) {
+			const char* const start = source + (size + alignment) % 8;
+			
+			reverse_memcpy_scalar(expected, start, size);
+			
+			// The extra trailing byte catches writes past the end of the buffer
+			memset(destination, 0, sizeof(destination));
+			function(destination + alignment, start, size);
+			
+			if (memcmp(destination + alignment, expected, size) != 0 || destination[alignment + size] != 0) {
+				return 0;
+			}
+		}
+	}
+	
+	return 1;
+	
+}
+
+char* reverse_memcpy_scalar(char* const destination, const char* const source, const size_t num) {
 	
 	for (size_t index = num; index > 0; index--) {
 		destination[num - index] = source[index - 1];
@@ -10,6 +192,60 @@ char* reverse_memcpy(char* const destination, const char* const source, const si
 	
 	return destination;
 	
+}
+
+char* reverse_memcpy(char* const destination, const char* const source, const size_t num) {
+	/*
+	Copies num bytes from source into destination in reverse order.
+	
+	Source and destination must not overlap.
+	*/
+	
+	if (kernel == NULL) {
+		reverse_memcpy_init();
+	}
+	
+	if (kernel_non_temporal != NULL && num >= non_temporal_threshold) {
+		return kernel_non_temporal->function(destination, source, num);
+	}
+	
+	return kernel->function(destination, source, num);
+	
+}
+
+char* reverse_inplace(char* const buffer, const size_t num) {
+	/*
+	Reverses num bytes of buffer in place.
+	
+	Blocks from both ends are reversed into a small bounce buffer and then copied
+	back crosswise, so that the byte shuffling itself is done by the selected
+	reverse_memcpy() kernel.
+	*/
+	
+	char bounce[INPLACE_BLOCK_SIZE * 2];
+	
+	size_t start = 0;
+	size_t end = num;
+	
+	while (end - start >= sizeof(bounce)) {
+		reverse_memcpy(bounce, buffer + end - INPLACE_BLOCK_SIZE, INPLACE_BLOCK_SIZE);
+		reverse_memcpy(bounce + INPLACE_BLOCK_SIZE, buffer + start, INPLACE_BLOCK_SIZE);
+		
+		memcpy(buffer + start, bounce, INPLACE_BLOCK_SIZE);
+		memcpy(buffer + end - INPLACE_BLOCK_SIZE, bounce + INPLACE_BLOCK_SIZE, INPLACE_BLOCK_SIZE);
+		
+		start += INPLACE_BLOCK_SIZE;
+		end -= INPLACE_BLOCK_SIZE;
+	}
+	
+	// The remaining middle part fits in the bounce buffer as a whole
+	const size_t size = end - start;
+	
+	reverse_memcpy(bounce, buffer + start, size);
+	memcpy(buffer + start, bounce, size);
+	
+	return buffer;
+	
 }
 /*
 int main() {
@@ -20,4 +256,4 @@ int main() {
 	reverse_memcpy(b, a, strlen(a));
 	puts(b);
 }
-*/
\ No newline at end of file
+*/
@@ -1,5 +1,21 @@
 #include <stdlib.h>
 
+typedef char* (*reverse_memcpy_t)(char* const destination, const char* const source, const size_t num);
+
+struct ReverseMemcpyKernel {
+	const char* name;
+	reverse_memcpy_t function;
+	int non_temporal;
+	int available;
+};
+
+void reverse_memcpy_init(void);
+const struct ReverseMemcpyKernel* reverse_memcpy_kernels(size_t* const count);
+const struct ReverseMemcpyKernel* reverse_memcpy_selected(void);
+int reverse_memcpy_verify(const reverse_memcpy_t function);
+
+char* reverse_memcpy_scalar(char* const destination, const char* const source, const size_t num);
 char* reverse_memcpy(char* const destination, const char* const source, const size_t num);
+char* reverse_inplace(char* const buffer, const size_t num);
 
 #pragma once
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "reverse_memcpy.h"
+#include "reverse_memcpy_vector.h"
+
+#if defined(HAVE_VECTOR_KERNEL)
+
+/*
+A portable kernel written with the GCC/Clang vector extensions.
+
+The byte reversal is expressed as a constant shuffle of a 16 byte vector, which the
+compiler lowers to the native permute instruction of the target (TBL/REV64+EXT on
+AArch64, VPERM on POWER and z/Architecture, VTBL on ARMv7 NEON and so on). On targets
+without vector registers it degrades to ordinary byte moves.
+
+Loads and stores go through memcpy() so that unaligned buffers are handled on
+architectures that trap on misaligned vector accesses.
+*/
+
+typedef unsigned char vector_u8x16 __attribute__((vector_size(16)));
+
+static inline vector_u8x16 reverse_u8x16(const vector_u8x16 value) {
+	
+	#if defined(HAVE_BUILTIN_SHUFFLEVECTOR)
+		return __builtin_shufflevector(value, value, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	#else
+		const vector_u8x16 mask = {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+		return __builtin_shuffle(value, mask);
+	#endif
+	
+}
+
+static inline vector_u8x16 load_u8x16(const char* const source) {
+	
+	vector_u8x16 value;
+	memcpy(&value, source, sizeof(value));
+	
+	return value;
+	
+}
+
+static inline void store_u8x16(char* const destination, const vector_u8x16 value) {
+	
+	memcpy(destination, &value, sizeof(value));
+	
+}
+
+char* reverse_memcpy_vector(char* const destination, const char* const source, const size_t num) {
+	
+	if (num < 16) {
+		return reverse_memcpy_scalar(destination, source, num);
+	}
+	
+	size_t offset = 0;
+	
+	while (num - offset >= 64) {
+		const char* const end = source + num - offset;
+		
+		const vector_u8x16 a = load_u8x16(end - 16);
+		const vector_u8x16 b = load_u8x16(end - 32);
+		const vector_u8x16 c = load_u8x16(end - 48);
+		const vector_u8x16 d = load_u8x16(end - 64);
+		
+		store_u8x16(destination + offset, reverse_u8x16(a));
+		store_u8x16(destination + offset + 16, reverse_u8x16(b));
+		store_u8x16(destination + offset + 32, reverse_u8x16(c));
+		store_u8x16(destination + offset + 48, reverse_u8x16(d));
+		
+		offset += 64;
+	}
+	
+	while (num - offset >= 16) {
+		store_u8x16(destination + offset, reverse_u8x16(load_u8x16(source + num - offset - 16)));
+		offset += 16;
+	}
+	
+	// Overlaps the previous store, see reverse_memcpy_x86.c
+	if (offset != num) {
+		store_u8x16(destination + num - 16, reverse_u8x16(load_u8x16(source)));
+	}
+	
+	return destination;
+	
+}
+
+#endif
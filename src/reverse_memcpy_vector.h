@@ -0,0 +1,9 @@
+#include <stdlib.h>
+
+#if defined(HAVE_BUILTIN_SHUFFLEVECTOR) || defined(HAVE_BUILTIN_SHUFFLE)
+	#define HAVE_VECTOR_KERNEL 1
+	
+	char* reverse_memcpy_vector(char* const destination, const char* const source, const size_t num);
+#endif
+
+#pragma once
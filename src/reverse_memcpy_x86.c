@@ -0,0 +1,414 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "reverse_memcpy.h"
+#include "reverse_memcpy_x86.h"
+
+#if defined(HAVE_X86_SIMD_KERNELS)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define X86_CPUID_1_ECX_SSSE3 (1U << 9)
+#define X86_CPUID_1_ECX_OSXSAVE (1U << 27)
+#define X86_CPUID_1_ECX_AVX (1U << 28)
+
+#define X86_CPUID_7_EBX_AVX2 (1U << 5)
+#define X86_CPUID_7_EBX_AVX512F (1U << 16)
+#define X86_CPUID_7_EBX_AVX512BW (1U << 30)
+#define X86_CPUID_7_ECX_AVX512VBMI (1U << 1)
+
+// XMM and YMM state
+#define X86_XCR0_AVX 0x06
+// XMM, YMM, opmask and ZMM state
+#define X86_XCR0_AVX512 0xE6
+
+static uint64_t x86_xgetbv(void) {
+	
+	uint32_t eax = 0;
+	uint32_t edx = 0;
+	
+	__asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	
+	return ((uint64_t) edx << 32) | eax;
+	
+}
+
+int x86_has_feature(const enum X86Feature feature) {
+	/*
+	Checks whether both the CPU and the operating system support a given instruction set extension.
+	
+	The CPUID bits alone are not enough for AVX2 and AVX-512: the kernel must also have enabled
+	saving of the wider register state (checked through XGETBV).
+	*/
+	
+	unsigned int eax = 0;
+	unsigned int ebx = 0;
+	unsigned int ecx = 0;
+	unsigned int edx = 0;
+	
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+		return 0;
+	}
+	
+	if (feature == X86_FEATURE_SSSE3) {
+		return (ecx & X86_CPUID_1_ECX_SSSE3) != 0;
+	}
+	
+	if ((ecx & X86_CPUID_1_ECX_OSXSAVE) == 0 || (ecx & X86_CPUID_1_ECX_AVX) == 0) {
+		return 0;
+	}
+	
+	const uint64_t xcr0 = x86_xgetbv();
+	
+	if (__get_cpuid_max(0, NULL) < 7) {
+		return 0;
+	}
+	
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	
+	switch (feature) {
+		case X86_FEATURE_AVX2:
+			return (xcr0 & X86_XCR0_AVX) == X86_XCR0_AVX && (ebx & X86_CPUID_7_EBX_AVX2) != 0;
+		case X86_FEATURE_AVX512VBMI:
+			return (
+				(xcr0 & X86_XCR0_AVX512) == X86_XCR0_AVX512 &&
+				(ebx & X86_CPUID_7_EBX_AVX512F) != 0 &&
+				(ebx & X86_CPUID_7_EBX_AVX512BW) != 0 &&
+				(ecx & X86_CPUID_7_ECX_AVX512VBMI) != 0
+			);
+		default:
+			return 0;
+	}
+	
+}
+
+static size_t x86_enumerate_caches(const unsigned int leaf) {
+	
+	size_t largest = 0;
+	
+	for (unsigned int subleaf = 0; subleaf < 16; subleaf++) {
+		unsigned int eax = 0;
+		unsigned int ebx = 0;
+		unsigned int ecx = 0;
+		unsigned int edx = 0;
+		
+		__cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+		
+		// Cache type 0 means there are no more caches to enumerate
+		if ((eax & 0x1F) == 0) {
+			break;
+		}
+		
+		const size_t ways = ((ebx >> 22) & 0x3FF) + 1;
+		const size_t partitions = ((ebx >> 12) & 0x3FF) + 1;
+		const size_t line_size = (ebx & 0xFFF) + 1;
+		const size_t sets = (size_t) ecx + 1;
+		
+		const size_t size = ways * partitions * line_size * sets;
+		
+		if (size > largest) {
+			largest = size;
+		}
+	}
+	
+	return largest;
+	
+}
+
+size_t x86_last_level_cache_size(void) {
+	/*
+	Returns the size of the largest cache reported by the CPU, in bytes.
+	
+	Intel exposes the cache topology through leaf 4, while AMD uses the equivalent leaf 0x8000001D.
+	
+	Returns (0) if it could not be determined.
+	*/
+	
+	size_t size = 0;
+	
+	if (__get_cpuid_max(0, NULL) >= 4) {
+		size = x86_enumerate_caches(4);
+	}
+	
+	if (size == 0 && __get_cpuid_max(0x80000000, NULL) >= 0x8000001D) {
+		size = x86_enumerate_caches(0x8000001D);
+	}
+	
+	return size;
+	
+}
+
+/*
+All kernels below fill the destination front to back while walking the source
+back to front: the block stored at destination + offset is the reversed block
+loaded from source + num - offset - width.
+
+When the size is not a multiple of the vector width, the last block is handled
+with one extra unaligned vector overlapping the previous store instead of a scalar
+loop. Source and destination must not overlap, just as with memcpy().
+*/
+
+__attribute__((target("ssse3")))
+static inline __m128i reverse_m128i(const __m128i value) {
+	
+	const __m128i mask = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	
+	return _mm_shuffle_epi8(value, mask);
+	
+}
+
+__attribute__((target("ssse3")))
+char* reverse_memcpy_ssse3(char* const destination, const char* const source, const size_t num) {
+	
+	if (num < 16) {
+		return reverse_memcpy_scalar(destination, source, num);
+	}
+	
+	size_t offset = 0;
+	
+	while (num - offset >= 64) {
+		const char* const end = source + num - offset;
+		
+		const __m128i a = _mm_loadu_si128((const __m128i*) (end - 16));
+		const __m128i b = _mm_loadu_si128((const __m128i*) (end - 32));
+		const __m128i c = _mm_loadu_si128((const __m128i*) (end - 48));
+		const __m128i d = _mm_loadu_si128((const __m128i*) (end - 64));
+		
+		_mm_storeu_si128((__m128i*) (destination + offset), reverse_m128i(a));
+		_mm_storeu_si128((__m128i*) (destination + offset + 16), reverse_m128i(b));
+		_mm_storeu_si128((__m128i*) (destination + offset + 32), reverse_m128i(c));
+		_mm_storeu_si128((__m128i*) (destination + offset + 48), reverse_m128i(d));
+		
+		offset += 64;
+	}
+	
+	while (num - offset >= 16) {
+		const __m128i a = _mm_loadu_si128((const __m128i*) (source + num - offset - 16));
+		_mm_storeu_si128((__m128i*) (destination + offset), reverse_m128i(a));
+		
+		offset += 16;
+	}
+	
+	if (offset != num) {
+		const __m128i a = _mm_loadu_si128((const __m128i*) source);
+		_mm_storeu_si128((__m128i*) (destination + num - 16), reverse_m128i(a));
+	}
+	
+	return destination;
+	
+}
+
+__attribute__((target("ssse3")))
+char* reverse_memcpy_ssse3_nt(char* const destination, const char* const source, const size_t num) {
+	
+	const size_t head = (size_t) (-(uintptr_t) destination & 15);
+	
+	if (num < head + 64) {
+		return reverse_memcpy_ssse3(destination, source, num);
+	}
+	
+	// Bring the destination up to a 16 byte boundary, as required by streaming stores
+	reverse_memcpy_ssse3(destination, source + num - head, head);
+	
+	size_t offset = head;
+	
+	while (num - offset >= 16) {
+		const __m128i a = _mm_loadu_si128((const __m128i*) (source + num - offset - 16));
+		_mm_stream_si128((__m128i*) (destination + offset), reverse_m128i(a));
+		
+		offset += 16;
+	}
+	
+	_mm_sfence();
+	
+	reverse_memcpy_ssse3(destination + offset, source, num - offset);
+	
+	return destination;
+	
+}
+
+__attribute__((target("avx2")))
+static inline __m256i reverse_m256i(const __m256i value) {
+	
+	const __m256i mask = _mm256_setr_epi8(
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+	);
+	
+	// vpshufb only shuffles within each 128 bit lane, so the two lanes are swapped afterwards
+	return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(value, mask), 0x4E);
+	
+}
+
+__attribute__((target("avx2")))
+char* reverse_memcpy_avx2(char* const destination, const char* const source, const size_t num) {
+	
+	if (num < 32) {
+		return reverse_memcpy_ssse3(destination, source, num);
+	}
+	
+	size_t offset = 0;
+	
+	while (num - offset >= 128) {
+		const char* const end = source + num - offset;
+		
+		const __m256i a = _mm256_loadu_si256((const __m256i*) (end - 32));
+		const __m256i b = _mm256_loadu_si256((const __m256i*) (end - 64));
+		const __m256i c = _mm256_loadu_si256((const __m256i*) (end - 96));
+		const __m256i d = _mm256_loadu_si256((const __m256i*) (end - 128));
+		
+		_mm256_storeu_si256((__m256i*) (destination + offset), reverse_m256i(a));
+		_mm256_storeu_si256((__m256i*) (destination + offset + 32), reverse_m256i(b));
+		_mm256_storeu_si256((__m256i*) (destination + offset + 64), reverse_m256i(c));
+		_mm256_storeu_si256((__m256i*) (destination + offset + 96), reverse_m256i(d));
+		
+		offset += 128;
+	}
+	
+	while (num - offset >= 32) {
+		const __m256i a = _mm256_loadu_si256((const __m256i*) (source + num - offset - 32));
+		_mm256_storeu_si256((__m256i*) (destination + offset), reverse_m256i(a));
+		
+		offset += 32;
+	}
+	
+	if (offset != num) {
+		const __m256i a = _mm256_loadu_si256((const __m256i*) source);
+		_mm256_storeu_si256((__m256i*) (destination + num - 32), reverse_m256i(a));
+	}
+	
+	return destination;
+	
+}
+
+__attribute__((target("avx2")))
+char* reverse_memcpy_avx2_nt(char* const destination, const char* const source, const size_t num) {
+	
+	const size_t head = (size_t) (-(uintptr_t) destination & 31);
+	
+	if (num < head + 128) {
+		return reverse_memcpy_avx2(destination, source, num);
+	}
+	
+	reverse_memcpy_avx2(destination, source + num - head, head);
+	
+	size_t offset = head;
+	
+	while (num - offset >= 128) {
+		const char* const end = source + num - offset;
+		
+		const __m256i a = _mm256_loadu_si256((const __m256i*) (end - 32));
+		const __m256i b = _mm256_loadu_si256((const __m256i*) (end - 64));
+		const __m256i c = _mm256_loadu_si256((const __m256i*) (end - 96));
+		const __m256i d = _mm256_loadu_si256((const __m256i*) (end - 128));
+		
+		_mm256_stream_si256((__m256i*) (destination + offset), reverse_m256i(a));
+		_mm256_stream_si256((__m256i*) (destination + offset + 32), reverse_m256i(b));
+		_mm256_stream_si256((__m256i*) (destination + offset + 64), reverse_m256i(c));
+		_mm256_stream_si256((__m256i*) (destination + offset + 96), reverse_m256i(d));
+		
+		offset += 128;
+	}
+	
+	_mm_sfence();
+	
+	reverse_memcpy_avx2(destination + offset, source, num - offset);
+	
+	return destination;
+	
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static inline __m512i reverse_m512i(const __m512i value) {
+	
+	static const unsigned char indices[64] = {
+		63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, 48,
+		47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32,
+		31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+	};
+	
+	return _mm512_permutexvar_epi8(_mm512_loadu_si512((const void*) indices), value);
+	
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+char* reverse_memcpy_avx512vbmi(char* const destination, const char* const source, const size_t num) {
+	
+	if (num < 64) {
+		return reverse_memcpy_avx2(destination, source, num);
+	}
+	
+	size_t offset = 0;
+	
+	while (num - offset >= 256) {
+		const char* const end = source + num - offset;
+		
+		const __m512i a = _mm512_loadu_si512((const void*) (end - 64));
+		const __m512i b = _mm512_loadu_si512((const void*) (end - 128));
+		const __m512i c = _mm512_loadu_si512((const void*) (end - 192));
+		const __m512i d = _mm512_loadu_si512((const void*) (end - 256));
+		
+		_mm512_storeu_si512((void*) (destination + offset), reverse_m512i(a));
+		_mm512_storeu_si512((void*) (destination + offset + 64), reverse_m512i(b));
+		_mm512_storeu_si512((void*) (destination + offset + 128), reverse_m512i(c));
+		_mm512_storeu_si512((void*) (destination + offset + 192), reverse_m512i(d));
+		
+		offset += 256;
+	}
+	
+	while (num - offset >= 64) {
+		const __m512i a = _mm512_loadu_si512((const void*) (source + num - offset - 64));
+		_mm512_storeu_si512((void*) (destination + offset), reverse_m512i(a));
+		
+		offset += 64;
+	}
+	
+	if (offset != num) {
+		const __m512i a = _mm512_loadu_si512((const void*) source);
+		_mm512_storeu_si512((void*) (destination + num - 64), reverse_m512i(a));
+	}
+	
+	return destination;
+	
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+char* reverse_memcpy_avx512vbmi_nt(char* const destination, const char* const source, const size_t num) {
+	
+	const size_t head = (size_t) (-(uintptr_t) destination & 63);
+	
+	if (num < head + 256) {
+		return reverse_memcpy_avx512vbmi(destination, source, num);
+	}
+	
+	reverse_memcpy_avx512vbmi(destination, source + num - head, head);
+	
+	size_t offset = head;
+	
+	while (num - offset >= 256) {
+		const char* const end = source + num - offset;
+		
+		const __m512i a = _mm512_loadu_si512((const void*) (end - 64));
+		const __m512i b = _mm512_loadu_si512((const void*) (end - 128));
+		const __m512i c = _mm512_loadu_si512((const void*) (end - 192));
+		const __m512i d = _mm512_loadu_si512((const void*) (end - 256));
+		
+		_mm512_stream_si512((void*) (destination + offset), reverse_m512i(a));
+		_mm512_stream_si512((void*) (destination + offset + 64), reverse_m512i(b));
+		_mm512_stream_si512((void*) (destination + offset + 128), reverse_m512i(c));
+		_mm512_stream_si512((void*) (destination + offset + 192), reverse_m512i(d));
+		
+		offset += 256;
+	}
+	
+	_mm_sfence();
+	
+	reverse_memcpy_avx512vbmi(destination + offset, source, num - offset);
+	
+	return destination;
+	
+}
+
+#endif
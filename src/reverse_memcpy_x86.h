@@ -0,0 +1,21 @@
+#include <stdlib.h>
+
+#if defined(HAVE_X86_SIMD_KERNELS)
+	enum X86Feature {
+		X86_FEATURE_SSSE3,
+		X86_FEATURE_AVX2,
+		X86_FEATURE_AVX512VBMI
+	};
+	
+	int x86_has_feature(const enum X86Feature feature);
+	size_t x86_last_level_cache_size(void);
+	
+	char* reverse_memcpy_ssse3(char* const destination, const char* const source, const size_t num);
+	char* reverse_memcpy_ssse3_nt(char* const destination, const char* const source, const size_t num);
+	char* reverse_memcpy_avx2(char* const destination, const char* const source, const size_t num);
+	char* reverse_memcpy_avx2_nt(char* const destination, const char* const source, const size_t num);
+	char* reverse_memcpy_avx512vbmi(char* const destination, const char* const source, const size_t num);
+	char* reverse_memcpy_avx512vbmi_nt(char* const destination, const char* const source, const size_t num);
+#endif
+
+#pragma once
@@ -0,0 +1,238 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#include "sparse_reverse.h"
+#include "reverse_memcpy.h"
+
+#if !defined(_WIN32) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+	#define HAVE_SEEK_DATA 1
+#endif
+
+#if defined(HAVE_SEEK_DATA)
+
+// Amount of data read and written at once
+#define SPARSE_CHUNK_SIZE (1024 * 1024)
+
+static void close_keep_errno(const int fd) {
+	
+	const int error = errno;
+	close(fd);
+	errno = error;
+	
+}
+
+static int is_zero(const char* const buffer, const size_t size) {
+	
+	return size == 0 || (buffer[0] == '\0' && memcmp(buffer, buffer + 1, size - 1) == 0);
+	
+}
+
+static int reverse_extent(const int input, const int output, char* const buffer, const off_t size, const off_t start, const off_t end) {
+	/*
+	Reverses the data extent [start, end) of input into its mirrored range of output,
+	[size - end, size - start).
+	
+	Chunks that turn out to be all zeros are not written, so that they stay holes in
+	output as well.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	char* const reverse_buffer = buffer + SPARSE_CHUNK_SIZE;
+	
+	off_t position = end;
+	
+	while (position > start) {
+		const off_t chunk_start = (position - start > SPARSE_CHUNK_SIZE) ? position - SPARSE_CHUNK_SIZE : start;
+		const size_t length = (size_t) (position - chunk_start);
+		
+		size_t done = 0;
+		
+		while (done < length) {
+			const ssize_t rsize = pread(input, buffer + done, length - done, chunk_start + (off_t) done);
+			
+			if (rsize == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				
+				return -1;
+			}
+			
+			// The file was truncated while it was being read
+			if (rsize == 0) {
+				errno = EIO;
+				return -1;
+			}
+			
+			done += (size_t) rsize;
+		}
+		
+		if (!is_zero(buffer, length)) {
+			reverse_memcpy(reverse_buffer, buffer, length);
+			
+			const off_t offset = size - position;
+			
+			done = 0;
+			
+			while (done < length) {
+				const ssize_t wsize = pwrite(output, reverse_buffer + done, length - done, offset + (off_t) done);
+				
+				if (wsize == -1) {
+					if (errno == EINTR) {
+						continue;
+					}
+					
+					return -1;
+				}
+				
+				done += (size_t) wsize;
+			}
+		}
+		
+		position = chunk_start;
+	}
+	
+	return 0;
+	
+}
+
+#endif
+
+int sparse_reverse(const char* const source, const char* const destination) {
+	/*
+	Writes the reversed content of source into destination, keeping the holes of
+	source as holes in destination.
+	
+	Destination is first extended to the size of source without allocating anything,
+	so that it starts out as one big hole. The data extents of source are then found
+	with SEEK_DATA and SEEK_HOLE, and only those are read and written to their mirrored
+	position. I/O thus scales with the allocated size of source rather than with its
+	apparent size.
+	
+	Sets errno to EINVAL if source has no holes, or if holes cannot be found on this
+	platform; callers should use another method in that case.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) source;
+		(void) destination;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#elif !defined(HAVE_SEEK_DATA)
+		(void) source;
+		(void) destination;
+		
+		errno = EINVAL;
+		
+		return -1;
+	#else
+		const int input = open(source, O_RDONLY);
+		
+		if (input == -1) {
+			return -1;
+		}
+		
+		struct stat st = {0};
+		
+		if (fstat(input, &st) == -1) {
+			close_keep_errno(input);
+			return -1;
+		}
+		
+		const off_t size = st.st_size;
+		
+		// Only files with fewer blocks allocated than their size can possibly have holes
+		if (!S_ISREG(st.st_mode) || size == 0 || (off_t) st.st_blocks * 512 >= size) {
+			close(input);
+			errno = EINVAL;
+			
+			return -1;
+		}
+		
+		const int output = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		
+		if (output == -1) {
+			close_keep_errno(input);
+			return -1;
+		}
+		
+		char* const buffer = malloc(SPARSE_CHUNK_SIZE * 2);
+		
+		if (buffer == NULL) {
+			close(input);
+			close(output);
+			
+			errno = ENOMEM;
+			
+			return -1;
+		}
+		
+		int status = 0;
+		
+		if (ftruncate(output, size) == -1) {
+			status = -1;
+		}
+		
+		off_t offset = 0;
+		
+		while (status == 0 && offset < size) {
+			const off_t start = lseek(input, offset, SEEK_DATA);
+			
+			if (start == -1) {
+				// Only holes are left
+				if (errno != ENXIO) {
+					status = -1;
+				}
+				
+				break;
+			}
+			
+			off_t end = lseek(input, start, SEEK_HOLE);
+			
+			if (end == -1) {
+				status = -1;
+				break;
+			}
+			
+			// The file grew since it was measured
+			if (end > size) {
+				end = size;
+			}
+			
+			status = reverse_extent(input, output, buffer, size, start, end);
+			
+			offset = end;
+		}
+		
+		free(buffer);
+		
+		close_keep_errno(input);
+		
+		if (close(output) == -1) {
+			status = -1;
+		}
+		
+		return status;
+	#endif
+	
+}
@@ -0,0 +1,270 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/uio.h>
+#endif
+
+#include "stdout_reverse.h"
+#include "reverse_memcpy.h"
+
+#if !defined(_WIN32)
+
+// Size of each buffer when output is not a pipe, or its size cannot be known
+#define STDOUT_CHUNK_SIZE (1024 * 1024)
+
+// Pipes are grown to this size if possible, so that each vmsplice() moves more data
+#define STDOUT_PIPE_SIZE (1024 * 1024)
+
+#if defined(__linux__) && defined(F_GETPIPE_SZ) && defined(F_SETPIPE_SZ)
+	#define HAVE_VMSPLICE 1
+#endif
+
+static int write_all(const int fd, const char* const buffer, const size_t size) {
+	
+	size_t done = 0;
+	
+	while (done < size) {
+		const ssize_t wsize = write(fd, buffer + done, size - done);
+		
+		if (wsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		done += (size_t) wsize;
+	}
+	
+	return 0;
+	
+}
+
+#if defined(HAVE_VMSPLICE)
+
+static size_t get_pipe_size(const int fd) {
+	/*
+	Returns the capacity of the pipe, after trying to grow it, or (0) if fd is not a pipe.
+	*/
+	
+	if (fcntl(fd, F_GETPIPE_SZ) == -1) {
+		return 0;
+	}
+	
+	// Unprivileged processes cannot go beyond /proc/sys/fs/pipe-max-size; the current size is fine then
+	fcntl(fd, F_SETPIPE_SZ, STDOUT_PIPE_SIZE);
+	
+	const int size = fcntl(fd, F_GETPIPE_SZ);
+	
+	return (size <= 0) ? 0 : (size_t) size;
+	
+}
+
+static int vmsplice_all(const int fd, char* const buffer, const size_t size) {
+	/*
+	Hands the pages of the buffer over to the pipe. The pipe then references them
+	rather than holding a copy, so they must not be modified until the reader has
+	consumed them.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = size
+	};
+	
+	while (iov.iov_len > 0) {
+		const ssize_t wsize = vmsplice(fd, &iov, 1, 0);
+		
+		if (wsize == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		iov.iov_base = (char*) iov.iov_base + wsize;
+		iov.iov_len -= (size_t) wsize;
+	}
+	
+	return 0;
+	
+}
+
+#endif
+
+#endif
+
+int stdout_reverse(const char* const source, const int output) {
+	/*
+	Writes the reversed content of source to output, which does not need to be
+	seekable.
+	
+	When output is a pipe, chunks are handed over with vmsplice() instead of being
+	copied into it. Two page-aligned buffers, each exactly as large as the pipe, are
+	used in turn: by the time the whole of one buffer has been spliced, the pipe can
+	no longer hold any page of the other one, so that one is free to be filled again.
+	Pages are never gifted (SPLICE_F_GIFT), as the buffers are reused. Any other kind
+	of output gets plain writes.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) source;
+		(void) output;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#else
+		const int input = open(source, O_RDONLY);
+		
+		if (input == -1) {
+			return -1;
+		}
+		
+		struct stat st = {0};
+		
+		if (fstat(input, &st) == -1) {
+			const int error = errno;
+			close(input);
+			
+			errno = error;
+			
+			return -1;
+		}
+		
+		size_t chunk_size = STDOUT_CHUNK_SIZE;
+		int use_vmsplice = 0;
+		
+		#if defined(HAVE_VMSPLICE)
+			const size_t pipe_size = get_pipe_size(output);
+			const long int page_size = sysconf(_SC_PAGESIZE);
+			
+			if (pipe_size > 0 && page_size > 0 && pipe_size % (size_t) page_size == 0) {
+				chunk_size = pipe_size;
+				use_vmsplice = 1;
+			}
+		#endif
+		
+		/*
+		The buffers are mapped rather than allocated: pages still referenced by the pipe once
+		they are unmapped stay intact until the reader is done with them, whereas freed heap
+		memory could be handed out again and overwritten while still in the pipe.
+		*/
+		void* const buffers = mmap(NULL, chunk_size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		
+		if (buffers == MAP_FAILED) {
+			const int error = errno;
+			close(input);
+			
+			errno = error;
+			
+			return -1;
+		}
+		
+		// The file is read backwards; the kernel's forward readahead would only get in the way
+		#if defined(POSIX_FADV_RANDOM)
+			posix_fadvise(input, 0, 0, POSIX_FADV_RANDOM);
+		#endif
+		
+		int status = 0;
+		size_t current = 0;
+		
+		off_t end = st.st_size;
+		
+		while (end > 0) {
+			const off_t start = (end > (off_t) chunk_size) ? end - (off_t) chunk_size : 0;
+			const size_t length = (size_t) (end - start);
+			
+			char* const buffer = (char*) buffers + current * chunk_size;
+			
+			#if defined(POSIX_FADV_WILLNEED)
+				if (start > 0) {
+					const off_t next = (start > (off_t) chunk_size) ? start - (off_t) chunk_size : 0;
+					posix_fadvise(input, next, start - next, POSIX_FADV_WILLNEED);
+				}
+			#endif
+			
+			size_t done = 0;
+			
+			while (done < length) {
+				const ssize_t rsize = pread(input, buffer + done, length - done, start + (off_t) done);
+				
+				if (rsize == -1 && errno == EINTR) {
+					continue;
+				}
+				
+				if (rsize <= 0) {
+					// The file was truncated while it was being read
+					if (rsize == 0) {
+						errno = EIO;
+					}
+					
+					status = -1;
+					
+					break;
+				}
+				
+				done += (size_t) rsize;
+			}
+			
+			if (status == -1) {
+				break;
+			}
+			
+			reverse_inplace(buffer, length);
+			
+			#if defined(HAVE_VMSPLICE)
+				if (use_vmsplice) {
+					status = vmsplice_all(output, buffer, length);
+					
+					// Pipes that cannot take spliced pages can still be written to
+					if (status == -1 && (errno == EINVAL || errno == ENOSYS)) {
+						use_vmsplice = 0;
+						status = write_all(output, buffer, length);
+					}
+				} else {
+					status = write_all(output, buffer, length);
+				}
+			#else
+				status = write_all(output, buffer, length);
+			#endif
+			
+			if (status == -1) {
+				break;
+			}
+			
+			current ^= 1;
+			end = start;
+		}
+		
+		const int error = errno;
+		
+		munmap(buffers, chunk_size * 2);
+		close(input);
+		
+		errno = error;
+		
+		return status;
+	#endif
+	
+}
@@ -0,0 +1,3 @@
+int stdout_reverse(const char* const source, const int output);
+
+#pragma once
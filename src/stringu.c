@@ -24,3 +24,58 @@ char* basename(const char* const path) {
 	return last_comp;
 	
 }
+
+int parse_size(const char* const value, uint64_t* const size) {
+	/*
+	Parses a size given on the command line, such as "512", "64K", "8M" or "1G".
+	
+	Suffixes are case insensitive and stand for powers of 1024.
+	
+	Returns (0) on success, (-1) if the value is not a valid size.
+	*/
+	
+	if (*value < '0' || *value > '9') {
+		return -1;
+	}
+	
+	char* end = NULL;
+	const unsigned long long int number = strtoull(value, &end, 10);
+	
+	uint64_t multiplier = 1;
+	
+	switch (*end) {
+		case '\0':
+			break;
+		case 'k':
+		case 'K':
+			multiplier = 1024ULL;
+			end++;
+			break;
+		case 'm':
+		case 'M':
+			multiplier = 1024ULL * 1024;
+			end++;
+			break;
+		case 'g':
+		case 'G':
+			multiplier = 1024ULL * 1024 * 1024;
+			end++;
+			break;
+		case 't':
+		case 'T':
+			multiplier = 1024ULL * 1024 * 1024 * 1024;
+			end++;
+			break;
+		default:
+			return -1;
+	}
+	
+	if (*end != '\0' || number > UINT64_MAX / multiplier) {
+		return -1;
+	}
+	
+	*size = (uint64_t) number * multiplier;
+	
+	return 0;
+	
+}
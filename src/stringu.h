@@ -1,5 +1,7 @@
 #include <stdlib.h>
+#include <stdint.h>
 
 char* basename(const char* const path);
+int parse_size(const char* const value, uint64_t* const size);
 
 #pragma once
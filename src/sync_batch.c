@@ -0,0 +1,391 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#include "sync_batch.h"
+#include "filesystem.h"
+
+#if defined(__linux__)
+	#define HAVE_SYNCFS 1
+#endif
+
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+	#define HAVE_SYNC_FILE_RANGE 1
+#endif
+
+struct SyncBatchItem {
+	char* filename;
+	struct TempFile tempfile;
+	int fd;
+	unsigned long int device;
+};
+
+static int sync_item(const struct SyncBatch* const batch, const size_t index) {
+	/*
+	Waits until the content of a file has reached the storage device.
+	
+	With syncfs(), a whole filesystem is synced at once, so files on a filesystem that
+	was already synced for an earlier item are skipped.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const struct SyncBatchItem* const item = &batch->items[index];
+	
+	#if defined(_WIN32)
+		return sync_file((item->tempfile.path == NULL) ? item->filename : item->tempfile.path);
+	#else
+		const int fd = (item->fd == -1) ? item->tempfile.fd : item->fd;
+		
+		#if defined(HAVE_SYNCFS)
+			for (size_t previous = 0; previous < index; previous++) {
+				if (batch->items[previous].device == item->device) {
+					return 0;
+				}
+			}
+			
+			return syncfs(fd);
+		#else
+			return fsync(fd);
+		#endif
+	#endif
+	
+}
+
+int sync_batch_add(struct SyncBatch* const batch, const char* const filename, struct TempFile* const tempfile) {
+	/*
+	Adds a file that was just written to the batch, and starts writing its content
+	back to the storage device without waiting for it.
+	
+	With a temporary file, it is taken over by the batch in all cases, and only
+	replaces filename once the batch is published. Without one, filename itself was
+	written, and is only synced.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct SyncBatchItem item = {
+		.filename = NULL,
+		.tempfile = {
+			.fd = -1
+		},
+		.fd = -1,
+		.device = 0
+	};
+	
+	if (tempfile != NULL) {
+		item.tempfile = *tempfile;
+		
+		memset(tempfile, 0, sizeof(*tempfile));
+		tempfile->fd = -1;
+	}
+	
+	item.filename = malloc(strlen(filename) + 1);
+	
+	if (item.filename == NULL) {
+		tempfile_discard(&item.tempfile);
+		
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	strcpy(item.filename, filename);
+	
+	#if !defined(_WIN32)
+		if (item.tempfile.fd == -1) {
+			item.fd = open(filename, O_RDONLY | O_CLOEXEC);
+		}
+		
+		const int fd = (item.fd == -1) ? item.tempfile.fd : item.fd;
+		
+		struct stat st = {0};
+		
+		if (fd == -1 || fstat(fd, &st) == -1) {
+			const int error = errno;
+			
+			if (item.fd != -1) {
+				close(item.fd);
+			}
+			
+			tempfile_discard(&item.tempfile);
+			free(item.filename);
+			
+			errno = error;
+			
+			return -1;
+		}
+		
+		item.device = (unsigned long int) st.st_dev;
+		
+		// Writeback starts now, so that syncing the batch later mostly has to wait for the journal
+		#if defined(HAVE_SYNC_FILE_RANGE)
+			sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+		#endif
+	#endif
+	
+	if (batch->count == batch->capacity) {
+		const size_t capacity = (batch->capacity == 0) ? SYNC_BATCH_SIZE : batch->capacity * 2;
+		struct SyncBatchItem* const items = realloc(batch->items, capacity * sizeof(*items));
+		
+		if (items == NULL) {
+			#if !defined(_WIN32)
+				if (item.fd != -1) {
+					close(item.fd);
+				}
+			#endif
+			
+			tempfile_discard(&item.tempfile);
+			free(item.filename);
+			
+			#if defined(_WIN32)
+				SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			#else
+				errno = ENOMEM;
+			#endif
+			
+			return -1;
+		}
+		
+		batch->items = items;
+		batch->capacity = capacity;
+	}
+	
+	batch->items[batch->count++] = item;
+	
+	return 0;
+	
+}
+
+static int fail(struct SyncBatch* const batch, const char* const filename) {
+	/*
+	Sets error_path to filename, keeping the current error.
+	
+	Returns (-1).
+	*/
+	
+	#if defined(_WIN32)
+		const DWORD error = GetLastError();
+	#else
+		const int error = errno;
+	#endif
+	
+	free(batch->error_path);
+	batch->error_path = malloc(strlen(filename) + 1);
+	
+	if (batch->error_path != NULL) {
+		strcpy(batch->error_path, filename);
+	}
+	
+	#if defined(_WIN32)
+		SetLastError(error);
+	#else
+		errno = error;
+	#endif
+	
+	return -1;
+	
+}
+
+int sync_batch_finish(struct SyncBatch* const batch, const enum Durability durability, const char* const filename, struct TempFile* const tempfile) {
+	/*
+	Takes care of a file that was just written: either filename itself, or its temporary
+	file, which then replaces filename. Data is synced as durability asks:
+	
+	- DURABILITY_NONE: nothing is synced
+	- DURABILITY_BATCH: the file is added to the batch, which is published once full
+	- DURABILITY_FILE: the file is synced on its own, and so is its directory once the
+	  temporary file replaced it
+	
+	The temporary file is released in all cases. On error, error_path is set to the
+	file that failed, which may be another file of the batch.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	switch (durability) {
+		case DURABILITY_NONE: {
+			break;
+		}
+		case DURABILITY_BATCH: {
+			if (sync_batch_add(batch, filename, tempfile) == -1) {
+				return fail(batch, filename);
+			}
+			
+			return (batch->count < SYNC_BATCH_SIZE) ? 0 : sync_batch_publish(batch);
+		}
+		case DURABILITY_FILE: {
+			const int status = (tempfile == NULL) ? sync_file(filename) : tempfile_sync(tempfile);
+			
+			if (status == -1) {
+				fail(batch, filename);
+				
+				if (tempfile != NULL) {
+					#if defined(_WIN32)
+						const DWORD error = GetLastError();
+						tempfile_discard(tempfile);
+						SetLastError(error);
+					#else
+						const int error = errno;
+						tempfile_discard(tempfile);
+						errno = error;
+					#endif
+				}
+				
+				return -1;
+			}
+			
+			break;
+		}
+	}
+	
+	if (tempfile == NULL) {
+		return 0;
+	}
+	
+	if (tempfile_publish(tempfile, filename) == -1) {
+		return fail(batch, filename);
+	}
+	
+	if (durability != DURABILITY_FILE) {
+		return 0;
+	}
+	
+	// The rename itself only survives a crash once the directory holding it is synced
+	if (sync_parent_directory(filename) == -1) {
+		return fail(batch, filename);
+	}
+	
+	return 0;
+	
+}
+
+int sync_batch_publish(struct SyncBatch* const batch) {
+	/*
+	Waits until the content of all files in the batch has reached the storage device,
+	and only then replaces each file with its temporary file.
+	
+	A crash at any point thus leaves every file either untouched or fully reversed.
+	The renames themselves become durable with the next sync of their filesystem;
+	until then, the original files are still there.
+	
+	The batch is emptied in all cases. If syncing fails, no file is replaced. If
+	replacing a file fails, the remaining ones are still replaced. Either way,
+	error_path is set to the first file that failed.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	int status = 0;
+	
+	#if defined(_WIN32)
+		DWORD error = 0;
+	#else
+		int error = 0;
+	#endif
+	
+	for (size_t index = 0; index < batch->count; index++) {
+		if (sync_item(batch, index) == -1) {
+			#if defined(_WIN32)
+				error = GetLastError();
+			#else
+				error = errno;
+			#endif
+			
+			status = -1;
+			
+			free(batch->error_path);
+			
+			batch->error_path = batch->items[index].filename;
+			batch->items[index].filename = NULL;
+			
+			break;
+		}
+	}
+	
+	for (size_t index = 0; index < batch->count; index++) {
+		struct SyncBatchItem* const item = &batch->items[index];
+		
+		if (status == 0 && item->tempfile.path != NULL && tempfile_publish(&item->tempfile, item->filename) == -1) {
+			#if defined(_WIN32)
+				const DWORD publish_error = GetLastError();
+			#else
+				const int publish_error = errno;
+			#endif
+			
+			if (error == 0) {
+				error = publish_error;
+				
+				free(batch->error_path);
+				
+				batch->error_path = item->filename;
+				item->filename = NULL;
+			}
+		}
+		
+		#if !defined(_WIN32)
+			if (item->fd != -1) {
+				close(item->fd);
+			}
+		#endif
+		
+		// Once syncing failed, the sources are left as they are
+		tempfile_discard(&item->tempfile);
+		free(item->filename);
+	}
+	
+	batch->count = 0;
+	
+	if (error != 0) {
+		#if defined(_WIN32)
+			SetLastError(error);
+		#else
+			errno = error;
+		#endif
+		
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+void sync_batch_free(struct SyncBatch* const batch) {
+	
+	for (size_t index = 0; index < batch->count; index++) {
+		struct SyncBatchItem* const item = &batch->items[index];
+		
+		#if !defined(_WIN32)
+			if (item->fd != -1) {
+				close(item->fd);
+			}
+		#endif
+		
+		tempfile_discard(&item->tempfile);
+		free(item->filename);
+	}
+	
+	free(batch->items);
+	free(batch->error_path);
+	
+	memset(batch, 0, sizeof(*batch));
+	
+}
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+
+#include "durability.h"
+#include "tempfile.h"
+
+// Number of files written before their data is synced and they are published
+#define SYNC_BATCH_SIZE 64
+
+struct SyncBatchItem;
+
+/*
+Files whose content was written but is not yet known to be on the storage device,
+along with the temporary files waiting to replace them.
+*/
+struct SyncBatch {
+	struct SyncBatchItem* items;
+	size_t count;
+	size_t capacity;
+	char* error_path;
+};
+
+int sync_batch_add(struct SyncBatch* const batch, const char* const filename, struct TempFile* const tempfile);
+int sync_batch_finish(struct SyncBatch* const batch, const enum Durability durability, const char* const filename, struct TempFile* const tempfile);
+int sync_batch_publish(struct SyncBatch* const batch);
+void sync_batch_free(struct SyncBatch* const batch);
+
+#pragma once
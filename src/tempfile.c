@@ -0,0 +1,325 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <process.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#include "tempfile.h"
+#include "constants.h"
+#include "filesystem.h"
+#include "stringu.h"
+
+#define TEMPFILE_SUFFIX ".revf-"
+
+// Distinguishes the temporary files of a single process
+static unsigned long int tempfile_sequence = 0;
+
+#if defined(O_TMPFILE)
+	#define HAVE_O_TMPFILE 1
+#endif
+
+#if defined(HAVE_O_TMPFILE)
+
+static int has_proc_fd(void) {
+	/*
+	Anonymous files can only be reopened and linked through /proc/self/fd.
+	*/
+	
+	static int available = -1;
+	
+	if (available == -1) {
+		available = (access("/proc/self/fd", X_OK) == 0);
+	}
+	
+	return available;
+	
+}
+
+#endif
+
+char* tempfile_name(const char* const filename) {
+	/*
+	Returns a new name for a temporary file in the same directory as filename, never
+	returned before by this process: <directory>/.<name>.revf-<pid>-<sequence>.
+	
+	The returned string must be freed by the caller.
+	
+	Returns a null pointer on error.
+	*/
+	
+	const char* const name = basename(filename);
+	const int directory_size = (int) (name - filename);
+	
+	#if defined(_WIN32)
+		const long int pid = (long int) _getpid();
+	#else
+		const long int pid = (long int) getpid();
+	#endif
+	
+	// Files may be reversed by several threads at once
+	#if defined(_WIN32)
+		const unsigned long int sequence = tempfile_sequence++;
+	#else
+		const unsigned long int sequence = __atomic_fetch_add(&tempfile_sequence, 1, __ATOMIC_RELAXED);
+	#endif
+	
+	const int size = snprintf(NULL, 0, "%.*s.%s%s%li-%lu", directory_size, filename, name, TEMPFILE_SUFFIX, pid, sequence);
+	
+	char* const path = malloc((size_t) size + 1);
+	
+	if (path == NULL) {
+		return NULL;
+	}
+	
+	snprintf(path, (size_t) size + 1, "%.*s.%s%s%li-%lu", directory_size, filename, name, TEMPFILE_SUFFIX, pid, sequence);
+	
+	return path;
+	
+}
+
+int tempfile_create(struct TempFile* const tempfile, const char* const filename) {
+	/*
+	Creates the temporary output for filename in its own directory, so that publishing
+	it is a rename within a filesystem and never needs to copy data. Concurrent runs
+	never collide either, as names are unique to each process.
+	
+	On Linux, the file is first created anonymously with O_TMPFILE, so that nothing is
+	left behind if revf is interrupted; it only gets a name when it is published. Other
+	systems, and filesystems without O_TMPFILE support, get a uniquely named file.
+	
+	Writers open the file through path; it is always empty, and owned by the caller.
+	The permissions of filename are only applied on publication, so that read-only
+	files can be written to in the meantime.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(tempfile, 0, sizeof(*tempfile));
+	tempfile->fd = -1;
+	
+	#if defined(_WIN32)
+		tempfile->name = tempfile_name(filename);
+		
+		if (tempfile->name == NULL) {
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return -1;
+		}
+		
+		tempfile->path = tempfile->name;
+		
+		return 0;
+	#else
+		struct stat st = {0};
+		
+		if (stat(filename, &st) == -1) {
+			return -1;
+		}
+		
+		tempfile->mode = (int) (st.st_mode & 07777);
+		
+		#if defined(HAVE_O_TMPFILE)
+			if (has_proc_fd()) {
+				const char* const name = basename(filename);
+				const size_t directory_size = (size_t) (name - filename);
+				
+				char directory[directory_size + 2];
+				
+				if (directory_size == 0) {
+					strcpy(directory, ".");
+				} else {
+					memcpy(directory, filename, directory_size);
+					directory[directory_size] = '\0';
+				}
+				
+				const int fd = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+				
+				if (fd != -1) {
+					char path[32];
+					snprintf(path, sizeof(path), "/proc/self/fd/%i", fd);
+					
+					tempfile->path = malloc(strlen(path) + 1);
+					
+					if (tempfile->path == NULL) {
+						close(fd);
+						
+						errno = ENOMEM;
+						
+						return -1;
+					}
+					
+					strcpy(tempfile->path, path);
+					tempfile->fd = fd;
+					
+					return 0;
+				}
+				
+				// Only fall back to a named file if the filesystem does not support anonymous ones
+				if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL) {
+					return -1;
+				}
+			}
+		#endif
+		
+		while (1) {
+			char* const name = tempfile_name(filename);
+			
+			if (name == NULL) {
+				errno = ENOMEM;
+				return -1;
+			}
+			
+			const int fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+			
+			if (fd == -1) {
+				free(name);
+				
+				// A leftover from an interrupted run of a process that had the same ID
+				if (errno == EEXIST) {
+					continue;
+				}
+				
+				return -1;
+			}
+			
+			tempfile->name = name;
+			tempfile->path = name;
+			tempfile->fd = fd;
+			
+			return 0;
+		}
+	#endif
+	
+}
+
+int tempfile_publish(struct TempFile* const tempfile, const char* const filename) {
+	/*
+	Atomically replaces filename with the temporary file, giving it the permissions
+	filename had. The temporary file is released in all cases.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		if (move_file(tempfile->name, filename) == -1) {
+			const DWORD error = GetLastError();
+			tempfile_discard(tempfile);
+			SetLastError(error);
+			
+			return -1;
+		}
+	#else
+		if (fchmod(tempfile->fd, (mode_t) tempfile->mode) == -1) {
+			const int error = errno;
+			tempfile_discard(tempfile);
+			errno = error;
+			
+			return -1;
+		}
+		
+		// Anonymous files must be linked under a temporary name first, as linkat() cannot replace filename
+		while (tempfile->name == NULL) {
+			char* const name = tempfile_name(filename);
+			
+			if (name == NULL) {
+				tempfile_discard(tempfile);
+				
+				errno = ENOMEM;
+				
+				return -1;
+			}
+			
+			if (linkat(AT_FDCWD, tempfile->path, AT_FDCWD, name, AT_SYMLINK_FOLLOW) == -1) {
+				const int error = errno;
+				free(name);
+				
+				if (error == EEXIST) {
+					continue;
+				}
+				
+				tempfile_discard(tempfile);
+				errno = error;
+				
+				return -1;
+			}
+			
+			tempfile->name = name;
+		}
+		
+		if (rename(tempfile->name, filename) == -1) {
+			const int error = errno;
+			tempfile_discard(tempfile);
+			errno = error;
+			
+			return -1;
+		}
+	#endif
+	
+	// The name now belongs to filename
+	if (tempfile->path == tempfile->name) {
+		tempfile->path = NULL;
+	}
+	
+	free(tempfile->name);
+	tempfile->name = NULL;
+	
+	tempfile_discard(tempfile);
+	
+	return 0;
+	
+}
+
+int tempfile_sync(struct TempFile* const tempfile) {
+	/*
+	Waits until the content of the temporary file has reached the storage device, so
+	that publishing it can never leave an empty or partial file behind after a crash.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		return sync_file(tempfile->path);
+	#else
+		return fsync(tempfile->fd);
+	#endif
+	
+}
+
+void tempfile_discard(struct TempFile* const tempfile) {
+	/*
+	Releases the temporary file, removing it if it was given a name.
+	*/
+	
+	if (tempfile->name != NULL) {
+		remove_file(tempfile->name);
+	}
+	
+	#if !defined(_WIN32)
+		if (tempfile->fd != -1) {
+			close(tempfile->fd);
+		}
+	#endif
+	
+	if (tempfile->path != tempfile->name) {
+		free(tempfile->path);
+	}
+	
+	free(tempfile->name);
+	
+	memset(tempfile, 0, sizeof(*tempfile));
+	tempfile->fd = -1;
+	
+}
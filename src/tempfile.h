@@ -0,0 +1,19 @@
+#include <stdlib.h>
+
+/*
+Output file written next to the file it is going to replace.
+*/
+struct TempFile {
+	char* path;
+	char* name;
+	int fd;
+	int mode;
+};
+
+char* tempfile_name(const char* const filename);
+int tempfile_create(struct TempFile* const tempfile, const char* const filename);
+int tempfile_sync(struct TempFile* const tempfile);
+int tempfile_publish(struct TempFile* const tempfile, const char* const filename);
+void tempfile_discard(struct TempFile* const tempfile);
+
+#pragma once
@@ -0,0 +1,658 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <pthread.h>
+	#include <sys/stat.h>
+#endif
+
+#include "tree_reverse.h"
+#include "constants.h"
+#include "fileinfo.h"
+#include "filesystem.h"
+#include "inplace.h"
+#include "sync_batch.h"
+#include "tempfile.h"
+#include "walkdir.h"
+
+#if !defined(_WIN32)
+
+struct TreeTask {
+	char* source;
+	char* destination;
+	int directory;
+};
+
+/*
+Tasks of a single worker. The worker pushes and pops tasks at the bottom, so that it
+walks its own part of the tree depth first; other workers steal from the top, where
+the oldest tasks are, which tend to be the largest subtrees.
+*/
+struct TreeDeque {
+	struct TreeTask* tasks;
+	size_t top;
+	size_t bottom;
+	size_t capacity;
+	pthread_mutex_t mutex;
+};
+
+struct TreeRun;
+
+struct TreeWorker {
+	struct TreeRun* run;
+	struct TreeDeque deque;
+	struct SyncBatch batch;
+	size_t index;
+	pthread_t thread;
+};
+
+struct TreeRun {
+	struct TreeReverse* tree;
+	struct TreeWorker* workers;
+	size_t count;
+	size_t queued;
+	size_t pending;
+	int error;
+	char* error_path;
+	unsigned long int device;
+	pthread_mutex_t mutex;
+	pthread_cond_t wakeup;
+};
+
+static int deque_push(struct TreeDeque* const deque, const struct TreeTask* const task) {
+	/*
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	pthread_mutex_lock(&deque->mutex);
+	
+	if (deque->bottom == deque->capacity) {
+		// Room freed by thieves at the top is reused before growing
+		if (deque->top > 0) {
+			memmove(deque->tasks, deque->tasks + deque->top, (deque->bottom - deque->top) * sizeof(*deque->tasks));
+			
+			deque->bottom -= deque->top;
+			deque->top = 0;
+		} else {
+			const size_t capacity = (deque->capacity == 0) ? 256 : deque->capacity * 2;
+			struct TreeTask* const tasks = realloc(deque->tasks, capacity * sizeof(*tasks));
+			
+			if (tasks == NULL) {
+				pthread_mutex_unlock(&deque->mutex);
+				
+				errno = ENOMEM;
+				
+				return -1;
+			}
+			
+			deque->tasks = tasks;
+			deque->capacity = capacity;
+		}
+	}
+	
+	deque->tasks[deque->bottom++] = *task;
+	
+	pthread_mutex_unlock(&deque->mutex);
+	
+	return 0;
+	
+}
+
+static int deque_take(struct TreeDeque* const deque, struct TreeTask* const task, const int steal) {
+	/*
+	Takes the newest task of the deque, or its oldest one when stealing.
+	
+	Returns (1) if a task was taken, (0) if the deque is empty.
+	*/
+	
+	pthread_mutex_lock(&deque->mutex);
+	
+	if (deque->top == deque->bottom) {
+		pthread_mutex_unlock(&deque->mutex);
+		return 0;
+	}
+	
+	*task = steal ? deque->tasks[deque->top++] : deque->tasks[--deque->bottom];
+	
+	if (deque->top == deque->bottom) {
+		deque->top = 0;
+		deque->bottom = 0;
+	}
+	
+	pthread_mutex_unlock(&deque->mutex);
+	
+	return 1;
+	
+}
+
+static void free_task(struct TreeTask* const task) {
+	
+	free(task->source);
+	free(task->destination);
+	
+	task->source = NULL;
+	task->destination = NULL;
+	
+}
+
+static void set_error(struct TreeRun* const run, const int error, const char* const path) {
+	/*
+	Records the first error of the run, after which no more tasks are started.
+	*/
+	
+	pthread_mutex_lock(&run->mutex);
+	
+	if (run->error == 0) {
+		run->error = (error == 0) ? EIO : error;
+		run->error_path = malloc(strlen(path) + 1);
+		
+		if (run->error_path != NULL) {
+			strcpy(run->error_path, path);
+		}
+	}
+	
+	pthread_cond_broadcast(&run->wakeup);
+	pthread_mutex_unlock(&run->mutex);
+	
+}
+
+static int add_skipped(struct TreeRun* const run, struct TreePaths* const paths, const char* const path) {
+	/*
+	Adds a path to a list of paths that were left out, which all threads share.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	char* const copy = malloc(strlen(path) + 1);
+	
+	if (copy == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	
+	strcpy(copy, path);
+	
+	pthread_mutex_lock(&run->mutex);
+	
+	if (paths->count == paths->capacity) {
+		const size_t capacity = (paths->capacity == 0) ? 16 : paths->capacity * 2;
+		char** const items = realloc(paths->paths, capacity * sizeof(*items));
+		
+		if (items == NULL) {
+			pthread_mutex_unlock(&run->mutex);
+			free(copy);
+			
+			errno = ENOMEM;
+			
+			return -1;
+		}
+		
+		paths->paths = items;
+		paths->capacity = capacity;
+	}
+	
+	paths->paths[paths->count++] = copy;
+	
+	pthread_mutex_unlock(&run->mutex);
+	
+	return 0;
+	
+}
+
+static int skip_linked_file(struct TreeRun* const run, const char* const filename) {
+	/*
+	Checks whether filename is a hard link to a file that was already reversed by
+	any thread, and adds it to the skipped links if so.
+	
+	Returns (1) if the file is to be skipped, (0) if it is to be reversed, (-1) on error.
+	*/
+	
+	struct FileInfo info = {0};
+	
+	// Errors are left for reversing the file to report
+	if (get_file_info(&info, filename) == -1 || info.type != FILEINFO_FILE || info.total_links < 2) {
+		return 0;
+	}
+	
+	const int added = file_id_set_add(run->tree->links, &info.id);
+	
+	if (added != 0) {
+		return (added == 1) ? 0 : -1;
+	}
+	
+	return (add_skipped(run, &run->tree->skipped_links, filename) == -1) ? -1 : 1;
+	
+}
+
+static int skip_directory(struct TreeRun* const run, const struct WalkDir* const walkdir, const char* const directory) {
+	/*
+	Checks whether the directory walkdir just opened is to be left out: with
+	one_file_system, if it is on another filesystem than the tree; with directories,
+	if any thread already walked it, in which case it is added to the skipped
+	directories. A directory can only be reached twice through a bind mount looping
+	back onto one of its ancestors, or another one of the same directory.
+	
+	Returns (1) if the directory is to be skipped, (0) if it is to be walked, (-1) on error.
+	*/
+	
+	struct TreeReverse* const tree = run->tree;
+	
+	if (tree->directories == NULL && !tree->one_file_system) {
+		return 0;
+	}
+	
+	struct FileID id = {0};
+	
+	if (walkdir_get_id(walkdir, &id) == -1) {
+		return -1;
+	}
+	
+	if (tree->one_file_system && id.device != run->device) {
+		return 1;
+	}
+	
+	if (tree->directories == NULL) {
+		return 0;
+	}
+	
+	const int added = file_id_set_add(tree->directories, &id);
+	
+	if (added != 0) {
+		return (added == 1) ? 0 : -1;
+	}
+	
+	return (add_skipped(run, &tree->skipped_directories, directory) == -1) ? -1 : 1;
+	
+}
+
+static int push_task(struct TreeWorker* const worker, const char* const source, const char* const destination, const int directory) {
+	/*
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct TreeRun* const run = worker->run;
+	
+	struct TreeTask task = {
+		.source = malloc(strlen(source) + 1),
+		.destination = (destination == NULL) ? NULL : malloc(strlen(destination) + 1),
+		.directory = directory
+	};
+	
+	if (task.source == NULL || (destination != NULL && task.destination == NULL)) {
+		free_task(&task);
+		
+		errno = ENOMEM;
+		
+		return -1;
+	}
+	
+	strcpy(task.source, source);
+	
+	if (destination != NULL) {
+		strcpy(task.destination, destination);
+	}
+	
+	if (deque_push(&worker->deque, &task) == -1) {
+		free_task(&task);
+		return -1;
+	}
+	
+	pthread_mutex_lock(&run->mutex);
+	
+	run->queued++;
+	run->pending++;
+	
+	pthread_cond_signal(&run->wakeup);
+	pthread_mutex_unlock(&run->mutex);
+	
+	return 0;
+	
+}
+
+static int take_task(struct TreeWorker* const worker, struct TreeTask* const task) {
+	/*
+	Takes a task from the deque of the worker, or else steals one from another worker.
+	
+	Returns (1) if a task was taken, (0) if there was none.
+	*/
+	
+	struct TreeRun* const run = worker->run;
+	
+	int taken = deque_take(&worker->deque, task, 0);
+	
+	for (size_t offset = 1; !taken && offset < run->count; offset++) {
+		taken = deque_take(&run->workers[(worker->index + offset) % run->count].deque, task, 1);
+	}
+	
+	if (taken) {
+		pthread_mutex_lock(&run->mutex);
+		run->queued--;
+		pthread_mutex_unlock(&run->mutex);
+	}
+	
+	return taken;
+	
+}
+
+static int reverse_file(struct TreeWorker* const worker, const struct TreeTask* const task) {
+	/*
+	Reverses a file in place, into its destination, or else into a temporary file that
+	replaces it. Each file is reversed by a single thread.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct TreeReverse* const tree = worker->run->tree;
+	
+	if (tree->links != NULL && task->destination == NULL) {
+		const int skip = skip_linked_file(worker->run, task->source);
+		
+		if (skip != 0) {
+			return (skip == -1) ? -1 : 0;
+		}
+	}
+	
+	if (tree->in_place) {
+		if (inplace_reverse(task->source, tree->journal) == -1) {
+			return -1;
+		}
+		
+		return sync_batch_finish(&worker->batch, tree->durability, task->source, NULL);
+	}
+	
+	struct TempFile tempfile = {
+		.fd = -1
+	};
+	
+	if (task->destination == NULL && tempfile_create(&tempfile, task->source) == -1) {
+		return -1;
+	}
+	
+	const char* const output = (task->destination == NULL) ? tempfile.path : task->destination;
+	
+	int status = tree->reverse(task->source, output);
+	
+	if (status == 0 && task->destination != NULL) {
+		status = copy_file_mode(task->source, task->destination);
+	}
+	
+	if (status == -1) {
+		const int error = errno;
+		tempfile_discard(&tempfile);
+		errno = error;
+		
+		return -1;
+	}
+	
+	if (task->destination != NULL) {
+		return sync_batch_finish(&worker->batch, tree->durability, task->destination, NULL);
+	}
+	
+	return sync_batch_finish(&worker->batch, tree->durability, task->source, &tempfile);
+	
+}
+
+static int reverse_directory(struct TreeWorker* const worker, const struct TreeTask* const task) {
+	/*
+	Pushes the content of a directory as new tasks, creating its destination first so
+	that the tasks of its files can be run by any worker straight away.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct WalkDir walkdir = {0};
+	
+	if (walkdir_init(&walkdir, task->source) == -1) {
+		return -1;
+	}
+	
+	const int skip = skip_directory(worker->run, &walkdir, task->source);
+	
+	if (skip != 0 || (task->destination != NULL && create_directory(task->destination) == -1)) {
+		const int error = errno;
+		walkdir_free(&walkdir);
+		errno = error;
+		
+		return (skip == 1) ? 0 : -1;
+	}
+	
+	int status = 0;
+	
+	while (status == 0) {
+		const struct WalkDirItem* const item = walkdir_next(&walkdir);
+		
+		if (item == NULL) {
+			break;
+		}
+		
+		const size_t destination_size = (task->destination == NULL) ? 0 : strlen(task->destination) + strlen(PATH_SEPARATOR) + strlen(item->name);
+		
+		char destination[destination_size + 1];
+		
+		if (task->destination != NULL) {
+			strcpy(destination, task->destination);
+			strcat(destination, PATH_SEPARATOR);
+			strcat(destination, item->name);
+		}
+		
+		status = push_task(worker, item->path, (task->destination == NULL) ? NULL : destination, item->type == WALKDIR_ITEM_DIRECTORY);
+	}
+	
+	const int error = errno;
+	walkdir_free(&walkdir);
+	errno = error;
+	
+	return status;
+	
+}
+
+static void* run_worker(void* const argument) {
+	
+	struct TreeWorker* const worker = argument;
+	struct TreeRun* const run = worker->run;
+	
+	while (1) {
+		struct TreeTask task = {0};
+		
+		if (!take_task(worker, &task)) {
+			pthread_mutex_lock(&run->mutex);
+			
+			// Tasks still running may push new ones
+			while (run->error == 0 && run->pending > 0 && run->queued == 0) {
+				pthread_cond_wait(&run->wakeup, &run->mutex);
+			}
+			
+			const int done = (run->error != 0 || run->pending == 0);
+			
+			pthread_mutex_unlock(&run->mutex);
+			
+			if (done) {
+				break;
+			}
+			
+			continue;
+		}
+		
+		pthread_mutex_lock(&run->mutex);
+		const int failed = (run->error != 0);
+		pthread_mutex_unlock(&run->mutex);
+		
+		if (!failed) {
+			free(worker->batch.error_path);
+			worker->batch.error_path = NULL;
+			
+			const int status = task.directory ? reverse_directory(worker, &task) : reverse_file(worker, &task);
+			
+			if (status == -1) {
+				set_error(run, errno, (worker->batch.error_path == NULL) ? task.source : worker->batch.error_path);
+			}
+		}
+		
+		free_task(&task);
+		
+		pthread_mutex_lock(&run->mutex);
+		
+		run->pending--;
+		
+		if (run->pending == 0) {
+			pthread_cond_broadcast(&run->wakeup);
+		}
+		
+		pthread_mutex_unlock(&run->mutex);
+	}
+	
+	// Files already in the batch of the worker are complete, even if another one failed
+	if (sync_batch_publish(&worker->batch) == -1) {
+		set_error(run, errno, (worker->batch.error_path == NULL) ? "" : worker->batch.error_path);
+	}
+	
+	return NULL;
+	
+}
+
+#endif
+
+int tree_reverse(struct TreeReverse* const tree, const char* const directory, const char* const destination) {
+	/*
+	Reverses all files under directory with tree->threads threads. With a destination,
+	the tree is recreated there with reversed files, and directory is left as is.
+	
+	Directories and files alike are tasks: reversing a directory means pushing its
+	entries as new tasks. Each thread has a deque of its own tasks, and steals from the
+	others once it runs out, so that all threads keep busy and many files are read and
+	written at once, whatever the shape of the tree.
+	
+	Reversed files are synced according to tree->durability; with DURABILITY_BATCH,
+	each thread keeps a batch of its own. All threads share tree->links, if any, so
+	that of the hard links to a file, exactly one gets it reversed, and likewise
+	tree->directories, so that no directory is walked twice.
+	
+	If anything fails, no more tasks are started, and error_path is set to the file or
+	directory that failed.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) tree;
+		(void) directory;
+		(void) destination;
+		
+		SetLastError(ERROR_NOT_SUPPORTED);
+		
+		return -1;
+	#else
+		struct TreeRun run = {
+			.tree = tree,
+			.count = (tree->threads == 0) ? 1 : tree->threads
+		};
+		
+		if (tree->one_file_system) {
+			struct stat st = {0};
+			
+			if (stat(directory, &st) == -1) {
+				return -1;
+			}
+			
+			run.device = (unsigned long int) st.st_dev;
+		}
+		
+		run.workers = calloc(run.count, sizeof(*run.workers));
+		
+		if (run.workers == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		
+		pthread_mutex_init(&run.mutex, NULL);
+		pthread_cond_init(&run.wakeup, NULL);
+		
+		for (size_t index = 0; index < run.count; index++) {
+			struct TreeWorker* const worker = &run.workers[index];
+			
+			worker->run = &run;
+			worker->index = index;
+			
+			pthread_mutex_init(&worker->deque.mutex, NULL);
+		}
+		
+		size_t started = 1;
+		
+		if (push_task(&run.workers[0], directory, destination, 1) == 0) {
+			// The calling thread takes part as well
+			for (size_t index = 1; index < run.count; index++) {
+				if (pthread_create(&run.workers[index].thread, NULL, run_worker, &run.workers[index]) != 0) {
+					break;
+				}
+				
+				started++;
+			}
+			
+			run_worker(&run.workers[0]);
+		} else {
+			set_error(&run, errno, directory);
+		}
+		
+		for (size_t index = 1; index < started; index++) {
+			pthread_join(run.workers[index].thread, NULL);
+		}
+		
+		// Workers that could not be started may still hold tasks; after an error, so may all others
+		for (size_t index = 0; index < run.count; index++) {
+			struct TreeWorker* const worker = &run.workers[index];
+			struct TreeTask task = {0};
+			
+			while (deque_take(&worker->deque, &task, 0)) {
+				free_task(&task);
+			}
+			
+			free(worker->deque.tasks);
+			pthread_mutex_destroy(&worker->deque.mutex);
+			
+			sync_batch_free(&worker->batch);
+		}
+		
+		free(run.workers);
+		
+		pthread_cond_destroy(&run.wakeup);
+		pthread_mutex_destroy(&run.mutex);
+		
+		if (run.error != 0) {
+			free(tree->error_path);
+			tree->error_path = run.error_path;
+			
+			errno = run.error;
+			
+			return -1;
+		}
+		
+		return 0;
+	#endif
+	
+}
+
+void tree_reverse_free(struct TreeReverse* const tree) {
+	
+	free(tree->error_path);
+	tree->error_path = NULL;
+	
+	struct TreePaths* const lists[] = {
+		&tree->skipped_links,
+		&tree->skipped_directories
+	};
+	
+	for (size_t list = 0; list < sizeof(lists) / sizeof(*lists); list++) {
+		for (size_t index = 0; index < lists[list]->count; index++) {
+			free(lists[list]->paths[index]);
+		}
+		
+		free(lists[list]->paths);
+		memset(lists[list], 0, sizeof(*lists[list]));
+	}
+	
+}
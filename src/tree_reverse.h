@@ -0,0 +1,45 @@
+#include <stdlib.h>
+
+#include "durability.h"
+#include "file_id_set.h"
+
+/*
+List of paths that were left out of a tree.
+*/
+struct TreePaths {
+	char** paths;
+	size_t count;
+	size_t capacity;
+};
+
+/*
+Settings and outcome of reversing a whole directory tree with several threads.
+
+Unless in_place is set, the content of each file is reversed into its output by
+reverse, which picks the engine; it is called from all threads at once.
+
+With in_place, files are reversed in place, keeping an undo journal if journal is
+set. With links, files with several hard links are only reversed through the first
+link met, and the other links are listed in skipped_links. With directories, a
+directory that was already walked is not walked again, and is listed in
+skipped_directories. With one_file_system, directories on another filesystem than
+the tree itself are left out.
+*/
+struct TreeReverse {
+	unsigned int threads;
+	int (*reverse)(const char* const source, const char* const output);
+	enum Durability durability;
+	int in_place;
+	int journal;
+	struct FileIDSet* links;
+	struct FileIDSet* directories;
+	int one_file_system;
+	char* error_path;
+	struct TreePaths skipped_links;
+	struct TreePaths skipped_directories;
+};
+
+int tree_reverse(struct TreeReverse* const tree, const char* const directory, const char* const destination);
+void tree_reverse_free(struct TreeReverse* const tree);
+
+#pragma once
@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+#endif
+
+#if defined(HAVE_IO_URING)
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+	#include <linux/io_uring.h>
+#endif
+
+#include "uring.h"
+
+#if defined(HAVE_IO_URING)
+
+static int io_uring_setup(const unsigned int entries, struct io_uring_params* const params) {
+	
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+	
+}
+
+static int io_uring_enter(const int fd, const unsigned int submit, const unsigned int wait, const unsigned int flags) {
+	
+	return (int) syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+	
+}
+
+static int io_uring_register(const int fd, const unsigned int opcode, const void* const argument, const unsigned int count) {
+	
+	return (int) syscall(__NR_io_uring_register, fd, opcode, argument, count);
+	
+}
+
+#endif
+
+int uring_init(struct Uring* const uring, const unsigned int entries) {
+	/*
+	Sets up a ring with room for the given number of submissions.
+	
+	Sets errno to ENOSYS on platforms without io_uring; the kernel may also refuse
+	with ENOSYS or EPERM when io_uring is disabled or filtered out by a sandbox.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(uring, 0, sizeof(*uring));
+	uring->fd = -1;
+	
+	#if defined(HAVE_IO_URING)
+		struct io_uring_params params = {0};
+		
+		const int fd = io_uring_setup(entries, &params);
+		
+		if (fd == -1) {
+			return -1;
+		}
+		
+		uring->fd = fd;
+		uring->entries = params.sq_entries;
+		
+		uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+		uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		
+		// Both rings live in a single mapping on kernels with IORING_FEAT_SINGLE_MMAP
+		if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0 && uring->cq_ring_size > uring->sq_ring_size) {
+			uring->sq_ring_size = uring->cq_ring_size;
+		}
+		
+		uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		
+		if (uring->sq_ring == MAP_FAILED) {
+			uring->sq_ring = NULL;
+			uring_free(uring);
+			
+			return -1;
+		}
+		
+		if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+			uring->cq_ring = uring->sq_ring;
+		} else {
+			uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			
+			if (uring->cq_ring == MAP_FAILED) {
+				uring->cq_ring = NULL;
+				uring_free(uring);
+				
+				return -1;
+			}
+		}
+		
+		uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+		uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		
+		if (uring->sqes == MAP_FAILED) {
+			uring->sqes = NULL;
+			uring_free(uring);
+			
+			return -1;
+		}
+		
+		char* const sq_ring = uring->sq_ring;
+		char* const cq_ring = uring->cq_ring;
+		
+		uring->sq_head = (unsigned int*) (sq_ring + params.sq_off.head);
+		uring->sq_tail = (unsigned int*) (sq_ring + params.sq_off.tail);
+		uring->sq_mask = (unsigned int*) (sq_ring + params.sq_off.ring_mask);
+		uring->sq_array = (unsigned int*) (sq_ring + params.sq_off.array);
+		
+		uring->cq_head = (unsigned int*) (cq_ring + params.cq_off.head);
+		uring->cq_tail = (unsigned int*) (cq_ring + params.cq_off.tail);
+		uring->cq_mask = (unsigned int*) (cq_ring + params.cq_off.ring_mask);
+		uring->cqes = (struct io_uring_cqe*) (cq_ring + params.cq_off.cqes);
+		
+		return 0;
+	#else
+		(void) entries;
+		
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_SUPPORTED);
+		#else
+			errno = ENOSYS;
+		#endif
+		
+		return -1;
+	#endif
+	
+}
+
+int uring_supports(struct Uring* const uring, const unsigned char* const opcodes, const size_t count) {
+	/*
+	Checks whether the running kernel implements all of the given operations.
+	
+	Returns (1) if it does, (0) otherwise.
+	*/
+	
+	#if defined(HAVE_IO_URING)
+		const size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+		struct io_uring_probe* const probe = calloc(1, size);
+		
+		if (probe == NULL) {
+			return 0;
+		}
+		
+		if (io_uring_register(uring->fd, IORING_REGISTER_PROBE, probe, 256) == -1) {
+			free(probe);
+			return 0;
+		}
+		
+		int supported = 1;
+		
+		for (size_t index = 0; index < count; index++) {
+			const unsigned char opcode = opcodes[index];
+			
+			if (opcode > probe->last_op || (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) == 0) {
+				supported = 0;
+				break;
+			}
+		}
+		
+		free(probe);
+		
+		return supported;
+	#else
+		(void) uring;
+		(void) opcodes;
+		(void) count;
+		
+		return 0;
+	#endif
+	
+}
+
+int uring_register_buffers(struct Uring* const uring, const struct iovec* const iovecs, const unsigned int count) {
+	/*
+	Registers buffers with the kernel, so that they can be used by fixed reads and
+	writes without being mapped on every request.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(HAVE_IO_URING)
+		return io_uring_register(uring->fd, IORING_REGISTER_BUFFERS, iovecs, count);
+	#else
+		(void) uring;
+		(void) iovecs;
+		(void) count;
+		
+		return -1;
+	#endif
+	
+}
+
+struct io_uring_sqe* uring_get_sqe(struct Uring* const uring) {
+	/*
+	Returns the next free submission entry, zeroed. It is handed to the kernel by the
+	next call to uring_submit().
+	
+	Returns a null pointer if the submission queue is full.
+	*/
+	
+	#if defined(HAVE_IO_URING)
+		const unsigned int head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+		const unsigned int tail = *uring->sq_tail + uring->pending;
+		
+		if (tail - head >= uring->entries) {
+			return NULL;
+		}
+		
+		const unsigned int index = tail & *uring->sq_mask;
+		
+		struct io_uring_sqe* const sqe = &uring->sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		
+		uring->sq_array[index] = index;
+		uring->pending++;
+		
+		return sqe;
+	#else
+		(void) uring;
+		
+		return NULL;
+	#endif
+	
+}
+
+int uring_submit(struct Uring* const uring, const unsigned int wait) {
+	/*
+	Submits the pending entries and waits until at least wait completions are available.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(HAVE_IO_URING)
+		__atomic_store_n(uring->sq_tail, *uring->sq_tail + uring->pending, __ATOMIC_RELEASE);
+		
+		unsigned int submit = uring->pending;
+		uring->pending = 0;
+		
+		while (1) {
+			const int status = io_uring_enter(uring->fd, submit, wait, (wait > 0) ? IORING_ENTER_GETEVENTS : 0);
+			
+			if (status == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				
+				return -1;
+			}
+			
+			submit -= (unsigned int) status;
+			
+			if (submit == 0 || wait > 0) {
+				break;
+			}
+		}
+		
+		return 0;
+	#else
+		(void) uring;
+		(void) wait;
+		
+		return -1;
+	#endif
+	
+}
+
+struct io_uring_cqe* uring_peek(struct Uring* const uring) {
+	/*
+	Returns the oldest completion not yet marked as seen, or a null pointer if there is none.
+	*/
+	
+	#if defined(HAVE_IO_URING)
+		const unsigned int head = *uring->cq_head;
+		
+		if (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+			return NULL;
+		}
+		
+		return &uring->cqes[head & *uring->cq_mask];
+	#else
+		(void) uring;
+		
+		return NULL;
+	#endif
+	
+}
+
+void uring_seen(struct Uring* const uring) {
+	
+	#if defined(HAVE_IO_URING)
+		__atomic_store_n(uring->cq_head, *uring->cq_head + 1, __ATOMIC_RELEASE);
+	#else
+		(void) uring;
+	#endif
+	
+}
+
+void uring_free(struct Uring* const uring) {
+	
+	#if defined(HAVE_IO_URING)
+		if (uring->sqes != NULL) {
+			munmap(uring->sqes, uring->sqes_size);
+		}
+		
+		if (uring->cq_ring != NULL && uring->cq_ring != uring->sq_ring) {
+			munmap(uring->cq_ring, uring->cq_ring_size);
+		}
+		
+		if (uring->sq_ring != NULL) {
+			munmap(uring->sq_ring, uring->sq_ring_size);
+		}
+		
+		if (uring->fd != -1) {
+			close(uring->fd);
+		}
+	#endif
+	
+	memset(uring, 0, sizeof(*uring));
+	uring->fd = -1;
+	
+}
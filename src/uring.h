@@ -0,0 +1,39 @@
+#include <stdlib.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct iovec;
+
+/*
+Minimal io_uring instance driven through the raw system calls.
+*/
+struct Uring {
+	int fd;
+	unsigned int entries;
+	unsigned int* sq_head;
+	unsigned int* sq_tail;
+	unsigned int* sq_mask;
+	unsigned int* sq_array;
+	unsigned int* cq_head;
+	unsigned int* cq_tail;
+	unsigned int* cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sq_ring;
+	size_t sq_ring_size;
+	void* cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	unsigned int pending;
+};
+
+int uring_init(struct Uring* const uring, const unsigned int entries);
+int uring_supports(struct Uring* const uring, const unsigned char* const opcodes, const size_t count);
+int uring_register_buffers(struct Uring* const uring, const struct iovec* const iovecs, const unsigned int count);
+struct io_uring_sqe* uring_get_sqe(struct Uring* const uring);
+int uring_submit(struct Uring* const uring, const unsigned int wait);
+struct io_uring_cqe* uring_peek(struct Uring* const uring);
+void uring_seen(struct Uring* const uring);
+void uring_free(struct Uring* const uring);
+
+#pragma once
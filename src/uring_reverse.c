@@ -0,0 +1,815 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <errno.h>
+#endif
+
+#if defined(HAVE_IO_URING)
+	#include <stdio.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+	#include <sys/uio.h>
+	#include <linux/io_uring.h>
+#endif
+
+#include "uring_reverse.h"
+#include "filesystem.h"
+#include "reverse_memcpy.h"
+#include "tempfile.h"
+
+#if defined(HAVE_IO_URING)
+
+// Number of files processed at once
+#define URING_REVERSE_SLOTS 32
+
+// Size of each of the two buffers owned by a file
+#define URING_REVERSE_CHUNK_SIZE (128 * 1024)
+
+// A file never has more than three requests in flight
+#define URING_REVERSE_ENTRIES 128
+
+enum UringReverseState {
+	URING_REVERSE_FREE,
+	URING_REVERSE_OPENING,
+	URING_REVERSE_CREATING,
+	URING_REVERSE_COPYING,
+	URING_REVERSE_SYNCING,
+	URING_REVERSE_CLOSING,
+	URING_REVERSE_RENAMING
+};
+
+enum UringReverseOperation {
+	URING_REVERSE_OPEN_INPUT,
+	URING_REVERSE_OPEN_OUTPUT,
+	URING_REVERSE_STATX,
+	URING_REVERSE_READ,
+	URING_REVERSE_WRITE,
+	URING_REVERSE_SYNC,
+	URING_REVERSE_CLOSE_INPUT,
+	URING_REVERSE_CLOSE_OUTPUT,
+	URING_REVERSE_RENAME
+};
+
+struct UringReverseBuffer {
+	char* data;
+	uint64_t chunk;
+	size_t length;
+	size_t done;
+};
+
+/*
+A file being reversed. It goes through the following states, each one made of requests
+that are all in flight at the same time:
+
+- opening: the source is opened while its size and permissions are queried
+- creating: its temporary file is created next to it, with the same permissions
+- copying: chunks are read from the end of the source into one buffer while the other
+  one is being reversed and written to the start of the temporary file
+- syncing: unless durability is none, the temporary file is flushed to the storage device
+- closing: both files are closed
+- renaming: the temporary file replaces the source, and with file durability, the
+  directory holding it is synced
+*/
+struct UringReverseSlot {
+	enum UringReverseState state;
+	char* source;
+	char* temporary;
+	int input;
+	int output;
+	int created;
+	struct statx stx;
+	uint64_t size;
+	uint64_t chunks;
+	uint64_t next_chunk;
+	unsigned int inflight;
+	int error;
+	struct UringReverseBuffer buffers[2];
+};
+
+static uint64_t pack_user_data(const size_t slot, const enum UringReverseOperation operation, const size_t buffer) {
+	
+	return ((uint64_t) slot << 16) | ((uint64_t) operation << 8) | (uint64_t) buffer;
+	
+}
+
+static struct io_uring_sqe* get_sqe(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	/*
+	Returns a submission entry for a request of the given file, flushing the queue to
+	the kernel if it is full.
+	
+	On error, the file is marked as failed and a null pointer is returned.
+	*/
+	
+	struct io_uring_sqe* sqe = uring_get_sqe(&engine->ring);
+	
+	if (sqe == NULL) {
+		if (uring_submit(&engine->ring, 0) == -1) {
+			if (slot->error == 0) {
+				slot->error = errno;
+			}
+			
+			return NULL;
+		}
+		
+		sqe = uring_get_sqe(&engine->ring);
+		
+		if (sqe == NULL) {
+			if (slot->error == 0) {
+				slot->error = EBUSY;
+			}
+			
+			return NULL;
+		}
+	}
+	
+	slot->inflight++;
+	
+	return sqe;
+	
+}
+
+static void submit_transfer(
+	struct UringReverse* const engine,
+	struct UringReverseSlot* const slot,
+	const enum UringReverseOperation operation,
+	const size_t index
+) {
+	/*
+	Reads the missing part of the buffer's chunk from the source, or writes its
+	remaining part to the temporary file.
+	*/
+	
+	const size_t slot_index = (size_t) (slot - engine->slots);
+	struct UringReverseBuffer* const buffer = &slot->buffers[index];
+	
+	struct io_uring_sqe* const sqe = get_sqe(engine, slot);
+	
+	if (sqe == NULL) {
+		return;
+	}
+	
+	const uint64_t destination_offset = buffer->chunk * URING_REVERSE_CHUNK_SIZE;
+	const uint64_t source_offset = slot->size - destination_offset - buffer->length;
+	
+	if (operation == URING_REVERSE_READ) {
+		sqe->opcode = engine->fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		sqe->fd = slot->input;
+		sqe->off = source_offset + buffer->done;
+	} else {
+		sqe->opcode = engine->fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		sqe->fd = slot->output;
+		sqe->off = destination_offset + buffer->done;
+	}
+	
+	sqe->addr = (uint64_t) (uintptr_t) (buffer->data + buffer->done);
+	sqe->len = (uint32_t) (buffer->length - buffer->done);
+	
+	if (engine->fixed_buffers) {
+		sqe->buf_index = (uint16_t) (slot_index * 2 + index);
+	}
+	
+	sqe->user_data = pack_user_data(slot_index, operation, index);
+	
+}
+
+static void submit_next_chunk(struct UringReverse* const engine, struct UringReverseSlot* const slot, const size_t index) {
+	
+	struct UringReverseBuffer* const buffer = &slot->buffers[index];
+	
+	buffer->chunk = slot->next_chunk++;
+	buffer->done = 0;
+	
+	const uint64_t offset = buffer->chunk * URING_REVERSE_CHUNK_SIZE;
+	buffer->length = (size_t) ((slot->size - offset < URING_REVERSE_CHUNK_SIZE) ? slot->size - offset : URING_REVERSE_CHUNK_SIZE);
+	
+	submit_transfer(engine, slot, URING_REVERSE_READ, index);
+	
+}
+
+static void submit_open(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	
+	const size_t slot_index = (size_t) (slot - engine->slots);
+	
+	struct io_uring_sqe* sqe = get_sqe(engine, slot);
+	
+	if (sqe == NULL) {
+		return;
+	}
+	
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t) (uintptr_t) slot->source;
+	sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	sqe->user_data = pack_user_data(slot_index, URING_REVERSE_OPEN_INPUT, 0);
+	
+	sqe = get_sqe(engine, slot);
+	
+	if (sqe == NULL) {
+		return;
+	}
+	
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t) (uintptr_t) slot->source;
+	sqe->len = STATX_SIZE | STATX_MODE;
+	sqe->off = (uint64_t) (uintptr_t) &slot->stx;
+	sqe->user_data = pack_user_data(slot_index, URING_REVERSE_STATX, 0);
+	
+}
+
+static void submit_create(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	/*
+	Creates the temporary file with the permissions of the source. These are subject to
+	the umask, so they are applied again with fchmod() once the file is open.
+	*/
+	
+	const size_t slot_index = (size_t) (slot - engine->slots);
+	
+	struct io_uring_sqe* const sqe = get_sqe(engine, slot);
+	
+	if (sqe == NULL) {
+		return;
+	}
+	
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t) (uintptr_t) slot->temporary;
+	sqe->len = (uint32_t) (slot->stx.stx_mode & 07777);
+	sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+	sqe->user_data = pack_user_data(slot_index, URING_REVERSE_OPEN_OUTPUT, 0);
+	
+}
+
+static void submit_sync(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	
+	const size_t slot_index = (size_t) (slot - engine->slots);
+	
+	struct io_uring_sqe* const sqe = get_sqe(engine, slot);
+	
+	if (sqe == NULL) {
+		return;
+	}
+	
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = slot->output;
+	sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sqe->user_data = pack_user_data(slot_index, URING_REVERSE_SYNC, 0);
+	
+}
+
+static void submit_close(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	
+	const size_t slot_index = (size_t) (slot - engine->slots);
+	
+	struct io_uring_sqe* sqe = get_sqe(engine, slot);
+	
+	if (sqe == NULL) {
+		return;
+	}
+	
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = slot->input;
+	sqe->user_data = pack_user_data(slot_index, URING_REVERSE_CLOSE_INPUT, 0);
+	
+	slot->input = -1;
+	
+	sqe = get_sqe(engine, slot);
+	
+	if (sqe == NULL) {
+		return;
+	}
+	
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = slot->output;
+	sqe->user_data = pack_user_data(slot_index, URING_REVERSE_CLOSE_OUTPUT, 0);
+	
+	slot->output = -1;
+	
+}
+
+static void submit_rename(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	
+	const size_t slot_index = (size_t) (slot - engine->slots);
+	
+	struct io_uring_sqe* const sqe = get_sqe(engine, slot);
+	
+	if (sqe == NULL) {
+		return;
+	}
+	
+	sqe->opcode = IORING_OP_RENAMEAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t) (uintptr_t) slot->temporary;
+	sqe->len = (uint32_t) AT_FDCWD;
+	sqe->addr2 = (uint64_t) (uintptr_t) slot->source;
+	sqe->user_data = pack_user_data(slot_index, URING_REVERSE_RENAME, 0);
+	
+}
+
+static void release_slot(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	
+	free(slot->source);
+	slot->source = NULL;
+	
+	free(slot->temporary);
+	slot->temporary = NULL;
+	
+	slot->state = URING_REVERSE_FREE;
+	engine->busy--;
+	
+}
+
+static void abort_slot(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	/*
+	Cleans up after a file whose requests failed, once none of them is in flight anymore.
+	The first error is kept as the error of the whole engine.
+	*/
+	
+	if (slot->input != -1) {
+		close(slot->input);
+		slot->input = -1;
+	}
+	
+	if (slot->output != -1) {
+		close(slot->output);
+		slot->output = -1;
+	}
+	
+	// The source is left untouched until the rename succeeds
+	if (slot->created) {
+		unlink(slot->temporary);
+	}
+	
+	if (engine->error == 0) {
+		engine->error = slot->error;
+		engine->error_path = slot->source;
+		
+		slot->source = NULL;
+	}
+	
+	release_slot(engine, slot);
+	
+}
+
+static void advance_slot(struct UringReverse* const engine, struct UringReverseSlot* const slot) {
+	/*
+	Moves a file to its next state once all the requests of the current one are done.
+	*/
+	
+	while (slot->state != URING_REVERSE_FREE && slot->inflight == 0) {
+		if (slot->error != 0) {
+			abort_slot(engine, slot);
+			break;
+		}
+		
+		switch (slot->state) {
+			case URING_REVERSE_OPENING: {
+				slot->state = URING_REVERSE_CREATING;
+				submit_create(engine, slot);
+				
+				break;
+			}
+			case URING_REVERSE_CREATING: {
+				slot->state = URING_REVERSE_COPYING;
+				slot->size = (uint64_t) slot->stx.stx_size;
+				slot->chunks = (slot->size + URING_REVERSE_CHUNK_SIZE - 1) / URING_REVERSE_CHUNK_SIZE;
+				slot->next_chunk = 0;
+				
+				for (size_t index = 0; index < 2 && slot->next_chunk < slot->chunks; index++) {
+					submit_next_chunk(engine, slot, index);
+				}
+				
+				break;
+			}
+			case URING_REVERSE_COPYING: {
+				if (engine->durability != DURABILITY_NONE) {
+					slot->state = URING_REVERSE_SYNCING;
+					submit_sync(engine, slot);
+					
+					break;
+				}
+				
+				slot->state = URING_REVERSE_CLOSING;
+				submit_close(engine, slot);
+				
+				break;
+			}
+			case URING_REVERSE_SYNCING: {
+				slot->state = URING_REVERSE_CLOSING;
+				submit_close(engine, slot);
+				
+				break;
+			}
+			case URING_REVERSE_CLOSING: {
+				slot->state = URING_REVERSE_RENAMING;
+				submit_rename(engine, slot);
+				
+				break;
+			}
+			case URING_REVERSE_RENAMING: {
+				slot->created = 0;
+				
+				// The rename itself only survives a crash once the directory holding it is synced
+				if (engine->durability == DURABILITY_FILE && sync_parent_directory(slot->source) == -1) {
+					slot->error = errno;
+					break;
+				}
+				
+				release_slot(engine, slot);
+				
+				break;
+			}
+			case URING_REVERSE_FREE: {
+				break;
+			}
+		}
+	}
+	
+}
+
+static void complete(struct UringReverse* const engine, const uint64_t user_data, const int result) {
+	
+	struct UringReverseSlot* const slot = &engine->slots[user_data >> 16];
+	const enum UringReverseOperation operation = (enum UringReverseOperation) ((user_data >> 8) & 0xFF);
+	const size_t index = (size_t) (user_data & 0xFF);
+	
+	slot->inflight--;
+	
+	/*
+	A leftover from an interrupted run of a process that had the same ID. The name is
+	unique to this process, so nothing else can be using it anymore; it is removed and
+	another name is tried.
+	*/
+	if (operation == URING_REVERSE_OPEN_OUTPUT && result == -EEXIST && slot->error == 0) {
+		unlink(slot->temporary);
+		free(slot->temporary);
+		
+		slot->temporary = tempfile_name(slot->source);
+		
+		if (slot->temporary == NULL) {
+			slot->error = ENOMEM;
+		} else {
+			submit_create(engine, slot);
+		}
+		
+		advance_slot(engine, slot);
+		
+		return;
+	}
+	
+	if (result < 0 && slot->error == 0 && operation != URING_REVERSE_CLOSE_INPUT) {
+		slot->error = -result;
+	}
+	
+	switch (operation) {
+		case URING_REVERSE_OPEN_INPUT: {
+			if (result >= 0) {
+				slot->input = result;
+			}
+			
+			break;
+		}
+		case URING_REVERSE_OPEN_OUTPUT: {
+			if (result >= 0) {
+				slot->output = result;
+				slot->created = 1;
+				
+				if (fchmod(slot->output, (mode_t) (slot->stx.stx_mode & 07777)) == -1 && slot->error == 0) {
+					slot->error = errno;
+				}
+			}
+			
+			break;
+		}
+		case URING_REVERSE_READ: {
+			if (result < 0 || slot->error != 0) {
+				break;
+			}
+			
+			struct UringReverseBuffer* const buffer = &slot->buffers[index];
+			
+			// The file was truncated while it was being read
+			if (result == 0) {
+				slot->error = EIO;
+				break;
+			}
+			
+			buffer->done += (size_t) result;
+			
+			if (buffer->done < buffer->length) {
+				submit_transfer(engine, slot, URING_REVERSE_READ, index);
+				break;
+			}
+			
+			reverse_inplace(buffer->data, buffer->length);
+			buffer->done = 0;
+			
+			submit_transfer(engine, slot, URING_REVERSE_WRITE, index);
+			
+			break;
+		}
+		case URING_REVERSE_WRITE: {
+			if (result < 0 || slot->error != 0) {
+				break;
+			}
+			
+			struct UringReverseBuffer* const buffer = &slot->buffers[index];
+			
+			buffer->done += (size_t) result;
+			
+			if (buffer->done < buffer->length) {
+				submit_transfer(engine, slot, URING_REVERSE_WRITE, index);
+				break;
+			}
+			
+			if (slot->next_chunk < slot->chunks) {
+				submit_next_chunk(engine, slot, index);
+			}
+			
+			break;
+		}
+		case URING_REVERSE_STATX: {
+			// Only regular files have content that can be replaced by a reversed copy
+			if (result >= 0 && slot->error == 0 && !S_ISREG(slot->stx.stx_mode)) {
+				slot->error = EINVAL;
+			}
+			
+			break;
+		}
+		case URING_REVERSE_SYNC:
+		case URING_REVERSE_CLOSE_INPUT:
+		case URING_REVERSE_CLOSE_OUTPUT:
+		case URING_REVERSE_RENAME: {
+			break;
+		}
+	}
+	
+	advance_slot(engine, slot);
+	
+}
+
+static int reap(struct UringReverse* const engine) {
+	/*
+	Submits the queued requests, waits for at least one of them to complete, and
+	processes all available completions.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (uring_submit(&engine->ring, 1) == -1) {
+		return -1;
+	}
+	
+	while (1) {
+		const struct io_uring_cqe* const cqe = uring_peek(&engine->ring);
+		
+		if (cqe == NULL) {
+			break;
+		}
+		
+		const uint64_t user_data = cqe->user_data;
+		const int result = cqe->res;
+		
+		uring_seen(&engine->ring);
+		
+		complete(engine, user_data, result);
+	}
+	
+	return 0;
+	
+}
+
+#endif
+
+int uring_reverse_init(struct UringReverse* const engine, const enum Durability durability) {
+	/*
+	Sets up the io_uring engine, which reverses many files at once.
+	
+	Requests for different files are submitted together, so that opening, reading,
+	writing, closing and renaming files costs a fraction of a system call each. Each
+	file is reversed through its own pair of buffers, registered with the kernel up
+	front.
+	
+	Temporary files are created next to the files they replace, so that the final
+	rename never crosses filesystems. Unless durability is DURABILITY_NONE, each of them
+	is flushed to the storage device before it is renamed; those flushes are in flight
+	together, and the filesystem commits them at once. That takes the place of the
+	batches of DURABILITY_BATCH. With DURABILITY_FILE, the directory is also synced
+	once the rename is done.
+	
+	Fails with ENOSYS if io_uring is not available, or if the kernel lacks one of the
+	operations needed (Linux 5.11 or later is required); callers should fall back to
+	another engine in that case.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(engine, 0, sizeof(*engine));
+	
+	engine->durability = durability;
+	
+	#if defined(HAVE_IO_URING)
+		if (uring_init(&engine->ring, URING_REVERSE_ENTRIES) == -1) {
+			return -1;
+		}
+		
+		static const unsigned char opcodes[] = {
+			IORING_OP_OPENAT,
+			IORING_OP_STATX,
+			IORING_OP_READ,
+			IORING_OP_WRITE,
+			IORING_OP_READ_FIXED,
+			IORING_OP_WRITE_FIXED,
+			IORING_OP_FSYNC,
+			IORING_OP_CLOSE,
+			IORING_OP_RENAMEAT
+		};
+		
+		if (!uring_supports(&engine->ring, opcodes, sizeof(opcodes) / sizeof(*opcodes))) {
+			uring_free(&engine->ring);
+			
+			errno = ENOSYS;
+			
+			return -1;
+		}
+		
+		engine->slots = calloc(URING_REVERSE_SLOTS, sizeof(*engine->slots));
+		
+		void* buffers = NULL;
+		
+		if (engine->slots == NULL || posix_memalign(&buffers, 4096, URING_REVERSE_SLOTS * 2 * URING_REVERSE_CHUNK_SIZE) != 0) {
+			uring_reverse_free(engine);
+			
+			errno = ENOMEM;
+			
+			return -1;
+		}
+		
+		engine->buffers = buffers;
+		
+		struct iovec iovecs[URING_REVERSE_SLOTS * 2];
+		
+		for (size_t index = 0; index < URING_REVERSE_SLOTS; index++) {
+			struct UringReverseSlot* const slot = &engine->slots[index];
+			
+			slot->input = -1;
+			slot->output = -1;
+			
+			for (size_t buffer = 0; buffer < 2; buffer++) {
+				char* const data = engine->buffers + (index * 2 + buffer) * URING_REVERSE_CHUNK_SIZE;
+				
+				slot->buffers[buffer].data = data;
+				
+				iovecs[index * 2 + buffer].iov_base = data;
+				iovecs[index * 2 + buffer].iov_len = URING_REVERSE_CHUNK_SIZE;
+			}
+		}
+		
+		// Registration may be refused because of RLIMIT_MEMLOCK; plain reads and writes work all the same
+		engine->fixed_buffers = (uring_register_buffers(&engine->ring, iovecs, URING_REVERSE_SLOTS * 2) == 0);
+		
+		return 0;
+	#else
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_SUPPORTED);
+		#else
+			errno = ENOSYS;
+		#endif
+		
+		return -1;
+	#endif
+	
+}
+
+int uring_reverse_add(struct UringReverse* const engine, const char* const filename) {
+	/*
+	Queues a file to be reversed.
+	
+	Requests are only handed to the kernel once all files slots are taken, in which case
+	this waits until one of them is free again. A file is thus not done when this returns;
+	call uring_reverse_wait() to wait for all queued files.
+	
+	If reversing any of the queued files failed, its error is returned here or by
+	uring_reverse_wait(), and error_path is set to that file.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(HAVE_IO_URING)
+		while (engine->error == 0 && engine->busy == URING_REVERSE_SLOTS) {
+			if (reap(engine) == -1) {
+				return -1;
+			}
+		}
+		
+		if (engine->error != 0) {
+			errno = engine->error;
+			return -1;
+		}
+		
+		struct UringReverseSlot* slot = engine->slots;
+		
+		while (slot->state != URING_REVERSE_FREE) {
+			slot++;
+		}
+		
+		slot->source = malloc(strlen(filename) + 1);
+		slot->temporary = tempfile_name(filename);
+		
+		if (slot->source == NULL || slot->temporary == NULL) {
+			free(slot->source);
+			free(slot->temporary);
+			
+			slot->source = NULL;
+			slot->temporary = NULL;
+			
+			errno = ENOMEM;
+			
+			return -1;
+		}
+		
+		strcpy(slot->source, filename);
+		
+		slot->state = URING_REVERSE_OPENING;
+		slot->created = 0;
+		slot->error = 0;
+		slot->inflight = 0;
+		
+		engine->busy++;
+		
+		submit_open(engine, slot);
+		advance_slot(engine, slot);
+		
+		return 0;
+	#else
+		(void) engine;
+		(void) filename;
+		
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_SUPPORTED);
+		#else
+			errno = ENOSYS;
+		#endif
+		
+		return -1;
+	#endif
+	
+}
+
+int uring_reverse_wait(struct UringReverse* const engine) {
+	/*
+	Waits until all queued files are done.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(HAVE_IO_URING)
+		while (engine->busy > 0) {
+			if (reap(engine) == -1) {
+				return -1;
+			}
+		}
+		
+		if (engine->error != 0) {
+			errno = engine->error;
+			return -1;
+		}
+	#else
+		(void) engine;
+	#endif
+	
+	return 0;
+	
+}
+
+void uring_reverse_free(struct UringReverse* const engine) {
+	
+	#if defined(HAVE_IO_URING)
+		uring_free(&engine->ring);
+		
+		if (engine->slots != NULL) {
+			for (size_t index = 0; index < URING_REVERSE_SLOTS; index++) {
+				free(engine->slots[index].source);
+				free(engine->slots[index].temporary);
+			}
+		}
+	#endif
+	
+	free(engine->slots);
+	free(engine->buffers);
+	free(engine->error_path);
+	
+	memset(engine, 0, sizeof(*engine));
+	
+}
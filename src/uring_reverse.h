@@ -0,0 +1,24 @@
+#include <stdlib.h>
+
+#include "durability.h"
+#include "uring.h"
+
+struct UringReverseSlot;
+
+struct UringReverse {
+	struct Uring ring;
+	struct UringReverseSlot* slots;
+	char* buffers;
+	int fixed_buffers;
+	enum Durability durability;
+	unsigned int busy;
+	int error;
+	char* error_path;
+};
+
+int uring_reverse_init(struct UringReverse* const engine, const enum Durability durability);
+int uring_reverse_add(struct UringReverse* const engine, const char* const filename);
+int uring_reverse_wait(struct UringReverse* const engine);
+void uring_reverse_free(struct UringReverse* const engine);
+
+#pragma once
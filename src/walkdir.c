@@ -1,16 +1,30 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #if defined(_WIN32)
 	#include <windows.h>
 #endif
 
 #if !defined(_WIN32)
+	#include <errno.h>
+	#include <fcntl.h>
 	#include <dirent.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
 #endif
 
-#if defined(__HAIKU__)
-	#include <sys/stat.h>
+#if defined(__linux__)
+	#include <limits.h>
+	#include <sys/syscall.h>
+#endif
+
+#if defined(HAVE_IO_URING)
+	#include <linux/io_uring.h>
 #endif
 
 #include "walkdir.h"
@@ -20,187 +34,1072 @@
 	#include "filesystem.h"
 #endif
 
-int walkdir_init(struct WalkDir* const walkdir, const char* const directory) {
+#if defined(HAVE_IO_URING)
+	#include "uring.h"
+#endif
+
+#if !defined(_WIN32)
+	// Directories deeper than this are read in one go and closed, so that deep trees cannot exhaust file descriptors
+	#define WALKDIR_MAX_OPEN 64
+#endif
+
+#if defined(__linux__) && defined(SYS_getdents64)
+	// Entries are read with getdents64() straight into a buffer of their directory, many at a time
+	#define WALKDIR_GETDENTS 1
 	
-	#if defined(_WIN32)
-		#if defined(_UNICODE)
-			const int absolute = is_absolute(directory);
-			
-			const int wpatterns = MultiByteToWideChar(CP_UTF8, 0, directory, -1, NULL, 0);
+	// Size of the buffer each open directory is read into; readdir() reads 32 KiB at a time
+	#define WALKDIR_BUFFER_SIZE (256 * 1024)
+#endif
+
+#if defined(WALKDIR_GETDENTS) && defined(HAVE_IO_URING)
+	// Entries of unknown type are resolved in batches of up to this many statx() requests
+	#define WALKDIR_URING_ENTRIES 64
+	
+	// Fewer entries than this are resolved with plain system calls, as a ring is not worth setting up
+	#define WALKDIR_URING_MIN 8
+#endif
+
+#if defined(__HAIKU__)
+	// Haiku has no d_type; the type of every entry has to be queried
+	#define WALKDIR_NO_D_TYPE 1
+#endif
+
+#if defined(WALKDIR_GETDENTS)
+
+// Layout of the records written by getdents64(), which glibc only exposes from 2.30 on
+struct WalkDirEntry {
+	uint64_t ino;
+	int64_t off;
+	unsigned short reclen;
+	unsigned char type;
+	char name[];
+};
+
+#endif
+
+#if defined(WALKDIR_GETDENTS) && defined(HAVE_IO_URING)
+
+struct WalkDirRing {
+	struct Uring uring;
+	struct statx stx[WALKDIR_URING_ENTRIES];
+};
+
+#endif
+
+struct WalkDirLevel {
+	size_t length;
+#if defined(_WIN32)
+	HANDLE handle;
+	WIN32_FIND_DATA data;
+	int pending;
+#elif defined(WALKDIR_GETDENTS)
+	int fd;
+	char* entries;
+	size_t entries_size;
+	size_t capacity;
+	size_t offset;
+#else
+	DIR* dir;
+	char* entries;
+	size_t entries_size;
+	size_t offset;
+#endif
+};
+
+static int reserve(struct WalkDir* const walkdir, const size_t size) {
+	/*
+	Makes room for a path of size bytes, terminator included, in the path buffer.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (size <= walkdir->size) {
+		return 0;
+	}
+	
+	size_t new_size = (walkdir->size == 0) ? 256 : walkdir->size;
+	
+	while (new_size < size) {
+		new_size *= 2;
+	}
+	
+	char* const path = realloc(walkdir->path, new_size);
+	
+	if (path == NULL) {
+		#if defined(_WIN32)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		#else
+			errno = ENOMEM;
+		#endif
+		
+		return -1;
+	}
+	
+	walkdir->path = path;
+	walkdir->size = new_size;
+	
+	return 0;
+	
+}
+
+static int append_name(struct WalkDir* const walkdir, const size_t length, const char* const name, const size_t name_length) {
+	/*
+	Replaces whatever follows the first length bytes of the path buffer with a separator
+	and name.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const size_t separator_length = strlen(PATH_SEPARATOR);
+	
+	if (reserve(walkdir, length + separator_length + name_length + 1) == -1) {
+		return -1;
+	}
+	
+	memcpy(walkdir->path + length, PATH_SEPARATOR, separator_length);
+	memcpy(walkdir->path + length + separator_length, name, name_length + 1);
+	
+	walkdir->length = length + separator_length + name_length;
+	
+	return 0;
+	
+}
+
+static struct WalkDirLevel* push_level(struct WalkDir* const walkdir) {
+	/*
+	Returns the new innermost level, or a null pointer on error.
+	*/
+	
+	if (walkdir->depth == walkdir->capacity) {
+		const size_t capacity = (walkdir->capacity == 0) ? 16 : walkdir->capacity * 2;
+		struct WalkDirLevel* const levels = realloc(walkdir->levels, capacity * sizeof(*levels));
+		
+		if (levels == NULL) {
+			#if defined(_WIN32)
+				SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			#else
+				errno = ENOMEM;
+			#endif
 			
-			if (wpatterns == 0) {
+			return NULL;
+		}
+		
+		walkdir->levels = levels;
+		walkdir->capacity = capacity;
+	}
+	
+	struct WalkDirLevel* const level = &walkdir->levels[walkdir->depth++];
+	
+	memset(level, 0, sizeof(*level));
+	level->length = walkdir->length;
+	
+	return level;
+	
+}
+
+static void pop_level(struct WalkDir* const walkdir) {
+	
+	struct WalkDirLevel* const level = &walkdir->levels[--walkdir->depth];
+	
+	#if defined(_WIN32)
+		FindClose(level->handle);
+	#elif defined(WALKDIR_GETDENTS)
+		if (level->fd != -1) {
+			close(level->fd);
+		}
+		
+		free(level->entries);
+	#else
+		if (level->dir != NULL) {
+			closedir(level->dir);
+		}
+		
+		free(level->entries);
+	#endif
+	
+}
+
+#if defined(_WIN32)
+
+static HANDLE find_first(const char* const directory, WIN32_FIND_DATA* const data) {
+	
+	#if defined(_UNICODE)
+		const int absolute = is_absolute(directory);
+		
+		const int wpatterns = MultiByteToWideChar(CP_UTF8, 0, directory, -1, NULL, 0);
+		
+		if (wpatterns == 0) {
+			return INVALID_HANDLE_VALUE;
+		}
+		
+		const int wpath_separators = MultiByteToWideChar(CP_UTF8, 0, PATH_SEPARATOR, -1, NULL, 0);
+		
+		if (wpath_separators == 0) {
+			return INVALID_HANDLE_VALUE;
+		}
+		
+		wchar_t wpath_separator[wpath_separators];
+		
+		if (MultiByteToWideChar(CP_UTF8, 0, PATH_SEPARATOR, -1, wpath_separator, wpath_separators) == 0) {
+			return INVALID_HANDLE_VALUE;
+		}
+		
+		const int wasterisks = MultiByteToWideChar(CP_UTF8, 0, ASTERISK, -1, NULL, 0);
+		
+		if (wasterisks == 0) {
+			return INVALID_HANDLE_VALUE;
+		}
+		
+		wchar_t wasterisk[wasterisks];
+		
+		if (MultiByteToWideChar(CP_UTF8, 0, ASTERISK, -1, wasterisk, wasterisks) == 0) {
+			return INVALID_HANDLE_VALUE;
+		}
+		
+		wchar_t wpattern[(absolute ? wcslen(WIN10LP_PREFIX) : 0) + wpatterns + wcslen(wpath_separator) + wcslen(wasterisk)];
+		
+		if (absolute) {
+			wcscpy(wpattern, WIN10LP_PREFIX);
+		}
+		
+		if (MultiByteToWideChar(CP_UTF8, 0, directory, -1, wpattern + (absolute ? wcslen(WIN10LP_PREFIX) : 0), wpatterns) == 0) {
+			return INVALID_HANDLE_VALUE;
+		}
+		
+		wcscat(wpattern, wpath_separator);
+		wcscat(wpattern, wasterisk);
+		
+		return FindFirstFileW(wpattern, data);
+	#else
+		char pattern[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(ASTERISK) + 1];
+		strcpy(pattern, directory);
+		strcat(pattern, PATH_SEPARATOR);
+		strcat(pattern, ASTERISK);
+		
+		return FindFirstFileA(pattern, data);
+	#endif
+	
+}
+
+static int open_level(struct WalkDir* const walkdir) {
+	/*
+	Starts walking the directory whose path is in the path buffer.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct WalkDirLevel* const level = push_level(walkdir);
+	
+	if (level == NULL) {
+		return -1;
+	}
+	
+	level->handle = find_first(walkdir->path, &level->data);
+	
+	if (level->handle == INVALID_HANDLE_VALUE) {
+		walkdir->depth--;
+		return -1;
+	}
+	
+	level->pending = 1;
+	
+	return 0;
+	
+}
+
+#else
+
+#if !defined(WALKDIR_NO_D_TYPE)
+
+static enum WalkDirType get_dirent_type(const unsigned char type) {
+	
+	switch (type) {
+		case DT_DIR:
+		case DT_BLK:
+			return WALKDIR_ITEM_DIRECTORY;
+		case DT_LNK:
+		case DT_FIFO:
+		case DT_REG:
+		case DT_SOCK:
+		case DT_CHR:
+			return WALKDIR_ITEM_FILE;
+		default:
+			return WALKDIR_ITEM_UNKNOWN;
+	}
+	
+}
+
+#endif
+
+static int is_dot(const char* const name) {
+	
+	return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+	
+}
+
+#if defined(WALKDIR_GETDENTS)
+
+static void resolve_entry(const int fd, struct WalkDirEntry* const entry) {
+	/*
+	Queries the type of an entry relative to its directory, leaving it unknown if
+	that fails.
+	*/
+	
+	struct stat st = {0};
+	
+	if (fstatat(fd, entry->name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+		entry->type = (unsigned char) IFTODT(st.st_mode);
+	}
+	
+}
+
+#if defined(HAVE_IO_URING)
+
+static struct Uring* get_ring(struct WalkDir* const walkdir) {
+	/*
+	Returns the ring of the walker, set up on first use, or a null pointer if io_uring
+	cannot be used to query entries.
+	*/
+	
+	if (walkdir->no_ring) {
+		return NULL;
+	}
+	
+	if (walkdir->ring != NULL) {
+		return &walkdir->ring->uring;
+	}
+	
+	walkdir->no_ring = 1;
+	
+	struct WalkDirRing* const ring = malloc(sizeof(*ring));
+	
+	if (ring == NULL) {
+		return NULL;
+	}
+	
+	if (uring_init(&ring->uring, WALKDIR_URING_ENTRIES) == -1) {
+		free(ring);
+		return NULL;
+	}
+	
+	static const unsigned char opcodes[] = {
+		IORING_OP_STATX
+	};
+	
+	if (!uring_supports(&ring->uring, opcodes, sizeof(opcodes) / sizeof(*opcodes))) {
+		uring_free(&ring->uring);
+		free(ring);
+		
+		return NULL;
+	}
+	
+	walkdir->ring = ring;
+	walkdir->no_ring = 0;
+	
+	return &ring->uring;
+	
+}
+
+static int resolve_ring(struct WalkDir* const walkdir, const int fd, struct WalkDirEntry** const entries, const size_t count) {
+	/*
+	Queries the type of up to WALKDIR_URING_ENTRIES entries with a single submission
+	of statx() requests. Entries that cannot be queried are left unknown.
+	
+	If the ring fails, it is not used again by the walker.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct Uring* const uring = get_ring(walkdir);
+	
+	if (uring == NULL) {
+		return -1;
+	}
+	
+	struct statx* const stx = walkdir->ring->stx;
+	
+	unsigned int submitted = 0;
+	
+	while (submitted < count) {
+		struct io_uring_sqe* const sqe = uring_get_sqe(uring);
+		
+		if (sqe == NULL) {
+			break;
+		}
+		
+		// Only the type is needed, which never requires a round trip to a network filesystem server
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t) (uintptr_t) entries[submitted]->name;
+		sqe->len = STATX_TYPE;
+		sqe->off = (uint64_t) (uintptr_t) &stx[submitted];
+		sqe->statx_flags = AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC;
+		sqe->user_data = submitted;
+		
+		submitted++;
+	}
+	
+	if (uring_submit(uring, submitted) == -1) {
+		walkdir->no_ring = 1;
+		return -1;
+	}
+	
+	unsigned int completed = 0;
+	
+	while (completed < submitted) {
+		const struct io_uring_cqe* const cqe = uring_peek(uring);
+		
+		if (cqe == NULL) {
+			if (uring_submit(uring, 1) == -1) {
+				walkdir->no_ring = 1;
 				return -1;
 			}
 			
-			const int wpath_separators = MultiByteToWideChar(CP_UTF8, 0, PATH_SEPARATOR, -1, NULL, 0);
+			continue;
+		}
+		
+		const size_t index = (size_t) cqe->user_data;
+		
+		if (cqe->res == 0 && index < submitted) {
+			entries[index]->type = (unsigned char) IFTODT(stx[index].stx_mode);
+		}
+		
+		uring_seen(uring);
+		completed++;
+	}
+	
+	// Entries the queue had no room for are queried one at a time
+	for (size_t index = submitted; index < count; index++) {
+		resolve_entry(fd, entries[index]);
+	}
+	
+	return 0;
+	
+}
+
+static void resolve_batch(struct WalkDir* const walkdir, const int fd, struct WalkDirEntry** const entries, const size_t count) {
+	/*
+	Queries the type of a batch of entries, through the ring if there are enough of
+	them to be worth setting it up, or if it already is.
+	*/
+	
+	if ((count >= WALKDIR_URING_MIN || walkdir->ring != NULL) && resolve_ring(walkdir, fd, entries, count) == 0) {
+		return;
+	}
+	
+	for (size_t index = 0; index < count; index++) {
+		resolve_entry(fd, entries[index]);
+	}
+	
+}
+
+#endif
+
+static void resolve_types(struct WalkDir* const walkdir, const int fd, char* const entries, const size_t size) {
+	/*
+	Fills in the type of the entries getdents64() could not tell, as happens on XFS
+	without ftype and on some network filesystems, so that none of them has to be
+	guessed later.
+	
+	With io_uring, entries are queried in batches, each costing a single system call;
+	otherwise, or for a handful of entries, they are queried one at a time.
+	*/
+	
+	#if defined(HAVE_IO_URING)
+		struct WalkDirEntry* batch[WALKDIR_URING_ENTRIES];
+		size_t count = 0;
+	#else
+		(void) walkdir;
+	#endif
+	
+	size_t offset = 0;
+	
+	while (offset < size) {
+		struct WalkDirEntry* const entry = (struct WalkDirEntry*) (entries + offset);
+		offset += entry->reclen;
+		
+		if (entry->type != DT_UNKNOWN) {
+			continue;
+		}
+		
+		#if defined(HAVE_IO_URING)
+			batch[count++] = entry;
 			
-			if (wpath_separators == 0) {
-				return -1;
+			if (count == WALKDIR_URING_ENTRIES) {
+				resolve_batch(walkdir, fd, batch, count);
+				count = 0;
 			}
+		#else
+			resolve_entry(fd, entry);
+		#endif
+	}
+	
+	#if defined(HAVE_IO_URING)
+		if (count > 0) {
+			resolve_batch(walkdir, fd, batch, count);
+		}
+	#endif
+	
+}
+
+static ssize_t read_entries(struct WalkDir* const walkdir, struct WalkDirLevel* const level, const size_t offset) {
+	/*
+	Reads as many entries of the directory of a level as fit into its buffer past
+	offset, and fills in their type.
+	
+	Returns the number of bytes read, (0) at the end of the directory, or (-1) on error.
+	*/
+	
+	const ssize_t size = (ssize_t) syscall(SYS_getdents64, level->fd, level->entries + offset, level->capacity - offset);
+	
+	if (size > 0) {
+		resolve_types(walkdir, level->fd, level->entries + offset, (size_t) size);
+	}
+	
+	return size;
+	
+}
+
+static int buffer_level(struct WalkDir* const walkdir, struct WalkDirLevel* const level) {
+	/*
+	Reads all entries of the directory of a level into its buffer, and closes the
+	directory. The buffer only grows once it has no room left for the largest entry,
+	and is shrunk to the entries it holds at the end.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const size_t largest = sizeof(struct WalkDirEntry) + NAME_MAX + 1;
+	
+	while (1) {
+		if (level->capacity - level->entries_size < largest) {
+			const size_t capacity = level->capacity * 2;
+			char* const entries = realloc(level->entries, capacity);
 			
-			wchar_t wpath_separator[wpath_separators];
-			
-			if (MultiByteToWideChar(CP_UTF8, 0, PATH_SEPARATOR, -1, wpath_separator, wpath_separators) == 0) {
+			if (entries == NULL) {
+				errno = ENOMEM;
 				return -1;
 			}
 			
-			const int wasterisks = MultiByteToWideChar(CP_UTF8, 0, ASTERISK, -1, NULL, 0);
-			
-			if (wasterisks == 0) {
+			level->entries = entries;
+			level->capacity = capacity;
+		}
+		
+		const ssize_t size = read_entries(walkdir, level, level->entries_size);
+		
+		if (size == -1) {
+			return -1;
+		}
+		
+		if (size == 0) {
+			break;
+		}
+		
+		level->entries_size += (size_t) size;
+	}
+	
+	close(level->fd);
+	level->fd = -1;
+	
+	// Failing to shrink the buffer only means keeping it as it is
+	if (level->entries_size > 0) {
+		char* const entries = realloc(level->entries, level->entries_size);
+		
+		if (entries != NULL) {
+			level->entries = entries;
+			level->capacity = level->entries_size;
+		}
+	}
+	
+	return 0;
+	
+}
+
+static int open_level(struct WalkDir* const walkdir, const int parent, const char* const name, const int flags) {
+	/*
+	Starts walking a directory, opened relative to the parent directory file descriptor,
+	or relative to the current directory if parent is AT_FDCWD.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | flags);
+	
+	if (fd == -1) {
+		return -1;
+	}
+	
+	struct WalkDirLevel* const level = push_level(walkdir);
+	
+	if (level == NULL) {
+		const int error = errno;
+		close(fd);
+		errno = error;
+		
+		return -1;
+	}
+	
+	level->fd = fd;
+	level->entries = malloc(WALKDIR_BUFFER_SIZE);
+	level->capacity = WALKDIR_BUFFER_SIZE;
+	
+	if (level->entries == NULL) {
+		pop_level(walkdir);
+		errno = ENOMEM;
+		
+		return -1;
+	}
+	
+	if (walkdir->depth > WALKDIR_MAX_OPEN && buffer_level(walkdir, level) == -1) {
+		const int error = errno;
+		pop_level(walkdir);
+		errno = error;
+		
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+static int get_level_fd(const struct WalkDirLevel* const level) {
+	/*
+	Returns the file descriptor of the directory of a level, or (-1) if it was closed.
+	*/
+	
+	return level->fd;
+	
+}
+
+#else
+
+static enum WalkDirType get_mode_type(const mode_t mode) {
+	
+	switch (mode & S_IFMT) {
+		case S_IFDIR:
+		case S_IFBLK:
+			return WALKDIR_ITEM_DIRECTORY;
+		case S_IFLNK:
+		case S_IFIFO:
+		case S_IFREG:
+		case S_IFSOCK:
+		case S_IFCHR:
+			return WALKDIR_ITEM_FILE;
+		default:
+			return WALKDIR_ITEM_UNKNOWN;
+	}
+	
+}
+
+static enum WalkDirType get_type(DIR* const dir, const struct dirent* const entry) {
+	/*
+	Returns the type of a directory entry, querying it relative to the directory if
+	readdir() could not tell.
+	*/
+	
+	#if !defined(WALKDIR_NO_D_TYPE)
+		const enum WalkDirType type = get_dirent_type(entry->d_type);
+		
+		if (type != WALKDIR_ITEM_UNKNOWN) {
+			return type;
+		}
+	#endif
+	
+	struct stat st = {0};
+	
+	if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+		return WALKDIR_ITEM_UNKNOWN;
+	}
+	
+	return get_mode_type(st.st_mode);
+	
+}
+
+static int buffer_level(struct WalkDirLevel* const level) {
+	/*
+	Reads all remaining entries of the directory of a level into memory, each one as a
+	type byte followed by its name, and closes the directory.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	size_t capacity = 0;
+	
+	while (1) {
+		errno = 0;
+		
+		const struct dirent* const entry = readdir(level->dir);
+		
+		if (entry == NULL) {
+			if (errno != 0) {
 				return -1;
 			}
 			
-			wchar_t wasterisk[wasterisks];
+			break;
+		}
+		
+		if (is_dot(entry->d_name)) {
+			continue;
+		}
+		
+		const size_t size = 1 + strlen(entry->d_name) + 1;
+		
+		if (level->entries_size + size > capacity) {
+			capacity = (capacity == 0) ? 4096 : capacity * 2;
 			
-			if (MultiByteToWideChar(CP_UTF8, 0, ASTERISK, -1, wasterisk, wasterisks) == 0) {
-				return -1;
+			while (level->entries_size + size > capacity) {
+				capacity *= 2;
 			}
 			
-			wchar_t wpattern[(absolute ? wcslen(WIN10LP_PREFIX) : 0) + wpatterns + wcslen(wpath_separator) + wcslen(wasterisk)];
-			
-			if (absolute) {
-				wcscpy(wpattern, WIN10LP_PREFIX);
-			}
+			char* const entries = realloc(level->entries, capacity);
 			
-			if (MultiByteToWideChar(CP_UTF8, 0, directory, -1, wpattern + (absolute ? wcslen(WIN10LP_PREFIX) : 0), wpatterns) == 0) {
+			if (entries == NULL) {
+				errno = ENOMEM;
 				return -1;
 			}
 			
-			wcscat(wpattern, wpath_separator);
-			wcscat(wpattern, wasterisk);
-			
-			walkdir->handle = FindFirstFileW(wpattern, &walkdir->data);
-		#else
-			char pattern[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(ASTERISK) + 1];
-			strcpy(pattern, directory);
-			strcat(pattern, PATH_SEPARATOR);
-			strcat(pattern, ASTERISK);
-			
-			walkdir->handle = FindFirstFileA(pattern, &walkdir->data);
-		#endif
-		
-		if (walkdir->handle == INVALID_HANDLE_VALUE) {
-			return -1;
+			level->entries = entries;
 		}
-	#else
-		walkdir->dir = opendir(directory);
 		
-		if (walkdir->dir == NULL) {
-			return -1;
-		}
+		level->entries[level->entries_size] = (char) get_type(level->dir, entry);
+		memcpy(level->entries + level->entries_size + 1, entry->d_name, size - 1);
 		
-		#if defined(__HAIKU__)
-			walkdir->directory = directory;
-		#endif
+		level->entries_size += size;
+	}
+	
+	closedir(level->dir);
+	level->dir = NULL;
+	
+	return 0;
+	
+}
+
+static int open_level(struct WalkDir* const walkdir, const int parent, const char* const name, const int flags) {
+	/*
+	Starts walking a directory, opened relative to the parent directory file descriptor,
+	or relative to the current directory if parent is AT_FDCWD.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | flags);
+	
+	if (fd == -1) {
+		return -1;
+	}
+	
+	DIR* const dir = fdopendir(fd);
+	
+	if (dir == NULL) {
+		const int error = errno;
+		close(fd);
+		errno = error;
+		
+		return -1;
+	}
+	
+	struct WalkDirLevel* const level = push_level(walkdir);
+	
+	if (level == NULL) {
+		closedir(dir);
+		return -1;
+	}
+	
+	level->dir = dir;
+	
+	if (walkdir->depth > WALKDIR_MAX_OPEN && buffer_level(level) == -1) {
+		const int error = errno;
+		pop_level(walkdir);
+		errno = error;
+		
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+static int get_level_fd(const struct WalkDirLevel* const level) {
+	/*
+	Returns the file descriptor of the directory of a level, or (-1) if it was closed.
+	*/
+	
+	return (level->dir == NULL) ? -1 : dirfd(level->dir);
+	
+}
+
+#endif
+
+#endif
+
+int walkdir_init(struct WalkDir* const walkdir, const char* const directory) {
+	/*
+	Starts walking a directory. Only its own entries are returned, unless the walker is
+	told to enter some of them; see walkdir_enter().
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(walkdir, 0, sizeof(*walkdir));
+	
+	const size_t length = strlen(directory);
+	
+	if (reserve(walkdir, length + 1) == -1) {
+		return -1;
+	}
+	
+	memcpy(walkdir->path, directory, length + 1);
+	walkdir->length = length;
+	
+	#if defined(_WIN32)
+		const int status = open_level(walkdir);
+	#else
+		const int status = open_level(walkdir, AT_FDCWD, directory, 0);
 	#endif
 	
+	if (status == -1) {
+		free(walkdir->path);
+		free(walkdir->levels);
+		
+		memset(walkdir, 0, sizeof(*walkdir));
+		
+		return -1;
+	}
+	
 	return 0;
 	
 }
 
 const struct WalkDirItem* walkdir_next(struct WalkDir* const walkdir) {
+	/*
+	Returns the next entry of the innermost directory being walked, moving back up to
+	its parent once it has no more entries. The "." and ".." entries are skipped.
 	
-	#if defined(_WIN32)
-		#if defined(_UNICODE)
-			if (walkdir->item.index > 0) {
-				if (FindNextFileW(walkdir->handle, &walkdir->data) == 0) {
+	The work done for each entry does not depend on its depth: its name is written
+	over that of the previous one in the path buffer, right after the path of its
+	directory.
+	
+	Returns a null pointer once the walk is over, or on error.
+	*/
+	
+	while (walkdir->depth > 0) {
+		struct WalkDirLevel* const level = &walkdir->levels[walkdir->depth - 1];
+		
+		#if defined(_WIN32)
+			if (!level->pending && FindNextFile(level->handle, &level->data) == 0) {
+				pop_level(walkdir);
+				continue;
+			}
+			
+			level->pending = 0;
+			
+			#if defined(_UNICODE)
+				const wchar_t* const wname = level->data.cFileName;
+				
+				if (wcscmp(wname, L".") == 0 || wcscmp(wname, L"..") == 0) {
+					continue;
+				}
+				
+				const int names = WideCharToMultiByte(CP_UTF8, 0, wname, -1, NULL, 0, NULL, NULL);
+				
+				if (names == 0) {
 					return NULL;
 				}
+				
+				const size_t separator_length = strlen(PATH_SEPARATOR);
+				
+				if (reserve(walkdir, level->length + separator_length + (size_t) names) == -1) {
+					return NULL;
+				}
+				
+				memcpy(walkdir->path + level->length, PATH_SEPARATOR, separator_length);
+				
+				if (WideCharToMultiByte(CP_UTF8, 0, wname, -1, walkdir->path + level->length + separator_length, names, NULL, NULL) == 0) {
+					return NULL;
+				}
+				
+				walkdir->length = level->length + separator_length + (size_t) names - 1;
+			#else
+				const char* const name = level->data.cFileName;
+				
+				if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+					continue;
+				}
+				
+				if (append_name(walkdir, level->length, name, strlen(name)) == -1) {
+					return NULL;
+				}
+			#endif
+			
+			walkdir->item.type = (level->data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) > 0 ? WALKDIR_ITEM_DIRECTORY : WALKDIR_ITEM_FILE;
+		#elif defined(WALKDIR_GETDENTS)
+			if (level->offset == level->entries_size) {
+				if (level->fd == -1) {
+					pop_level(walkdir);
+					continue;
+				}
+				
+				// A whole buffer of entries is read at once; the ones after it cost no system call
+				const ssize_t size = read_entries(walkdir, level, 0);
+				
+				if (size <= 0) {
+					pop_level(walkdir);
+					continue;
+				}
+				
+				level->entries_size = (size_t) size;
+				level->offset = 0;
 			}
 			
-			if (WideCharToMultiByte(CP_UTF8, 0, walkdir->data.cFileName, -1, walkdir->item.name, sizeof(walkdir->item.name), NULL, NULL) == 0) {
+			const struct WalkDirEntry* const entry = (const struct WalkDirEntry*) (level->entries + level->offset);
+			level->offset += entry->reclen;
+			
+			if (is_dot(entry->name)) {
+				continue;
+			}
+			
+			walkdir->item.type = get_dirent_type(entry->type);
+			
+			if (append_name(walkdir, level->length, entry->name, strlen(entry->name)) == -1) {
 				return NULL;
 			}
 		#else
-			if (walkdir->item.index > 0) {
-				if (FindNextFileA(walkdir->handle, &walkdir->data) == 0) {
-					return NULL;
+			const char* name = NULL;
+			size_t name_length = 0;
+			
+			if (level->dir == NULL) {
+				if (level->offset == level->entries_size) {
+					pop_level(walkdir);
+					continue;
 				}
+				
+				walkdir->item.type = (enum WalkDirType) level->entries[level->offset];
+				
+				name = level->entries + level->offset + 1;
+				name_length = strlen(name);
+				
+				level->offset += 1 + name_length + 1;
+			} else {
+				const struct dirent* const entry = readdir(level->dir);
+				
+				if (entry == NULL) {
+					pop_level(walkdir);
+					continue;
+				}
+				
+				if (is_dot(entry->d_name)) {
+					continue;
+				}
+				
+				walkdir->item.type = get_type(level->dir, entry);
+				
+				name = entry->d_name;
+				name_length = strlen(name);
 			}
 			
-			if (strlen(walkdir->data.cFileName) > (sizeof(walkdir->item.name) -1)) {
+			if (append_name(walkdir, level->length, name, name_length) == -1) {
 				return NULL;
 			}
-			
-			strcpy(walkdir->item.name, walkdir->data.cFileName);
 		#endif
 		
-		walkdir->item.type = (walkdir->data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) > 0 ? WALKDIR_ITEM_DIRECTORY : WALKDIR_ITEM_FILE;
+		walkdir->item.path = walkdir->path;
+		walkdir->item.name = walkdir->path + level->length + strlen(PATH_SEPARATOR);
+		walkdir->item.depth = walkdir->depth - 1;
+		
+		return &walkdir->item;
+	}
+	
+	return NULL;
+	
+}
+
+int walkdir_enter(struct WalkDir* const walkdir) {
+	/*
+	Descends into the directory last returned by walkdir_next(), whose entries are
+	returned next, before the remaining ones of its parent.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		return open_level(walkdir);
 	#else
-		const struct dirent* const item = readdir(walkdir->dir);
+		const int parent = get_level_fd(&walkdir->levels[walkdir->depth - 1]);
 		
-		if (item == NULL) {
-			return NULL;
+		// Symbolic links are never entered; O_NOFOLLOW keeps it so if one replaced the directory meanwhile
+		const int flags = O_NOFOLLOW;
+		
+		// Directories that were read in one go are closed; only the full path leads to their entries then
+		if (parent == -1) {
+			return open_level(walkdir, AT_FDCWD, walkdir->path, flags);
 		}
 		
-		if (strlen(item->d_name) > (sizeof(walkdir->item.name) - 1)) {
-			return NULL;
+		return open_level(walkdir, parent, walkdir->item.name, flags);
+	#endif
+	
+}
+
+int walkdir_get_id(const struct WalkDir* const walkdir, struct FileID* const id) {
+	/*
+	Looks up the file ID of the innermost directory being walked. Right after
+	walkdir_init() or walkdir_enter(), that is the directory just opened, which
+	callers can use to tell whether it is worth walking at all.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		struct FileInfo info = {0};
+		
+		if (get_file_info(&info, walkdir->path) == -1) {
+			return -1;
 		}
 		
-		strcpy(walkdir->item.name, item->d_name);
+		*id = info.id;
+	#else
+		const int fd = get_level_fd(&walkdir->levels[walkdir->depth - 1]);
 		
-		#if defined(__HAIKU__)
-			char path[strlen(walkdir->directory) + strlen(PATH_SEPARATOR) + strlen(item->d_name) + 1];
-			strcpy(path, walkdir->directory);
-			strcat(path, PATH_SEPARATOR);
-			strcat(path, item->d_name);
-			
-			struct stat st = {0};
-			
-			if (stat(path, &st) == -1) {
-				return NULL;
-			}
-		#endif
+		struct stat st = {0};
 		
-		#if defined(__HAIKU__)
-			switch (st.st_mode & S_IFMT) {
-				case S_IFDIR:
-				case S_IFBLK:
-					walkdir->item.type = WALKDIR_ITEM_DIRECTORY;
-					break;
-				case S_IFLNK:
-				case S_IFIFO:
-				case S_IFREG:
-				case S_IFSOCK:
-				case S_IFCHR:
-					walkdir->item.type = WALKDIR_ITEM_FILE;
-					break;
-				default:
-					walkdir->item.type = WALKDIR_ITEM_UNKNOWN;
-					break;
-			}
-		#else
-			switch (item->d_type) {
-				case DT_DIR:
-				case DT_BLK:
-					walkdir->item.type = WALKDIR_ITEM_DIRECTORY;
-					break;
-				case DT_LNK:
-				case DT_FIFO:
-				case DT_REG:
-				case DT_SOCK:
-				case DT_CHR:
-					walkdir->item.type = WALKDIR_ITEM_FILE;
-					break;
-				case DT_UNKNOWN:
-					walkdir->item.type = WALKDIR_ITEM_UNKNOWN;
-					break;
-			}
-		#endif
+		// The path buffer still holds the path of the directory until the next entry is returned
+		if (((fd == -1) ? stat(walkdir->path, &st) : fstat(fd, &st)) == -1) {
+			return -1;
+		}
+		
+		id->device = (unsigned long int) st.st_dev;
+		id->file = (unsigned long int) st.st_ino;
 	#endif
 	
-	walkdir->item.index++;
+	return 0;
+	
+}
+
+void walkdir_leave(struct WalkDir* const walkdir) {
+	/*
+	Stops walking the innermost directory; the remaining entries of its parent are
+	returned next.
+	*/
 	
-	return &walkdir->item;
+	pop_level(walkdir);
 	
 }
 
 void walkdir_free(struct WalkDir* const walkdir) {
 	
-	#if defined(_WIN32)
-		FindClose(walkdir->handle);
-	#else
-		closedir(walkdir->dir);
+	while (walkdir->depth > 0) {
+		pop_level(walkdir);
+	}
+	
+	free(walkdir->levels);
+	free(walkdir->path);
+	
+	#if defined(WALKDIR_GETDENTS) && defined(HAVE_IO_URING)
+		if (walkdir->ring != NULL) {
+			uring_free(&walkdir->ring->uring);
+			free(walkdir->ring);
+		}
 	#endif
 	
+	memset(walkdir, 0, sizeof(*walkdir));
+	
 }
@@ -1,14 +1,6 @@
 #include <stdlib.h>
 
-#ifdef _WIN32
-	#include <windows.h>
-	#include <stdio.h>
-	
-	#define NAME_MAX (_MAX_FNAME - 1)
-#else
-	#include <limits.h>
-	#include <dirent.h>
-#endif
+#include "fileinfo.h"
 
 enum WalkDirType {
 	WALKDIR_ITEM_DIRECTORY,
@@ -16,27 +8,47 @@ enum WalkDirType {
 	WALKDIR_ITEM_UNKNOWN
 };
 
+/*
+An entry of the tree being walked. name and path point into the path buffer of the
+walker, and are only valid until the next call to walkdir_next().
+*/
 struct WalkDirItem {
 	enum WalkDirType type;
-	size_t index;
-	char name[NAME_MAX + 1];
+	const char* name;
+	const char* path;
+	size_t depth;
 };
 
+struct WalkDirLevel;
+struct WalkDirRing;
+
+/*
+Iterator over a directory tree, which only descends into the directories it is told
+to. Directories being walked are kept on an explicit stack rather than the call
+stack, and the paths of all entries are built in a single buffer, which is truncated
+and appended to in place.
+
+On Linux, entries are read many at a time with getdents64(), and those whose type
+the filesystem does not report are queried in batches through an io_uring ring,
+which is set up on first use.
+*/
 struct WalkDir {
 	struct WalkDirItem item;
-#ifdef _WIN32
-	HANDLE handle;
-	WIN32_FIND_DATA data;
-#else
-	DIR* dir;
-#endif
-#ifdef __HAIKU__
-	const char* directory;
-#endif
+	char* path;
+	size_t length;
+	size_t size;
+	struct WalkDirLevel* levels;
+	size_t depth;
+	size_t capacity;
+	struct WalkDirRing* ring;
+	int no_ring;
 };
 
 int walkdir_init(struct WalkDir* const walkdir, const char* const directory);
 const struct WalkDirItem* walkdir_next(struct WalkDir* const walkdir);
+int walkdir_enter(struct WalkDir* const walkdir);
+int walkdir_get_id(const struct WalkDir* const walkdir, struct FileID* const id);
+void walkdir_leave(struct WalkDir* const walkdir);
 void walkdir_free(struct WalkDir* const walkdir);
 
 #pragma once
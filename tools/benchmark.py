@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+
+"""
+End-to-end benchmark for revf.
+
+Runs the real "revf -r" pipeline against a dataset built by generate_dataset.py and
+reports files/s, MB/s and the peak resident set size, with a cold and a warm page cache.
+
+Every run reverses the whole tree, so an even number of runs leaves the content of the
+dataset as it was generated. Replacing a file detaches it from its other hard links, so
+the links of the hard link set are recreated before each run, outside of the timing.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+def scan(directory):
+	"""
+	Returns the number of regular files and their total size.
+	"""
+
+	files = 0
+	total = 0
+
+	for (root, _, names) in os.walk(directory):
+		for name in names:
+			path = os.path.join(root, name)
+
+			if os.path.islink(path) or not os.path.isfile(path):
+				continue
+
+			files += 1
+			total += os.path.getsize(path)
+
+	return (files, total)
+
+def drop_caches(directory):
+	"""
+	Evicts the dataset from the page cache.
+
+	As root, this drops the whole page cache. Otherwise, each file is flushed and
+	evicted with posix_fadvise(), which is good enough for the files revf reads.
+	"""
+
+	os.sync()
+
+	try:
+		with open("/proc/sys/vm/drop_caches", "w") as file:
+			file.write("3\n")
+
+		return
+	except OSError:
+		pass
+
+	for (root, _, names) in os.walk(directory):
+		for name in names:
+			path = os.path.join(root, name)
+
+			if os.path.islink(path) or not os.path.isfile(path):
+				continue
+
+			fd = os.open(path, os.O_RDONLY)
+
+			try:
+				os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+			finally:
+				os.close(fd)
+
+def warm_caches(directory):
+
+	for (root, _, names) in os.walk(directory):
+		for name in names:
+			path = os.path.join(root, name)
+
+			if os.path.islink(path) or not os.path.isfile(path):
+				continue
+
+			with open(path, "rb") as file:
+				while file.read(1024 * 1024):
+					pass
+
+def relink(directory):
+	"""
+	Links each file of the hard link set back to its primary copy, as generate_dataset.py
+	created it.
+	"""
+
+	primary = os.path.join(directory, "hardlinks", "primary")
+	secondary = os.path.join(directory, "hardlinks", "secondary")
+
+	for (root, _, names) in os.walk(primary):
+		for name in names:
+			source = os.path.join(root, name)
+			link = os.path.join(secondary, os.path.relpath(source, primary))
+
+			if os.path.exists(link) and os.path.samefile(source, link):
+				continue
+
+			if os.path.lexists(link):
+				os.unlink(link)
+
+			os.link(source, link)
+
+def run(revf, arguments, directory):
+	"""
+	Runs revf once and returns the elapsed time and its peak RSS, in bytes.
+	"""
+
+	command = [revf] + arguments + [directory]
+
+	start = time.monotonic()
+
+	process = subprocess.Popen(
+		command,
+		stdout = subprocess.DEVNULL
+	)
+
+	(_, status, usage) = os.wait4(process.pid, 0)
+
+	elapsed = time.monotonic() - start
+
+	# Let Popen know the process has already been reaped
+	process.returncode = os.waitstatus_to_exitcode(status)
+
+	if process.returncode != 0:
+		print("fatal error: '%s' exited with status %i" % (" ".join(command), process.returncode), file = sys.stderr)
+		sys.exit(1)
+
+	# ru_maxrss is in kilobytes on Linux
+	return (elapsed, usage.ru_maxrss * 1024)
+
+parser = argparse.ArgumentParser(
+	description = "Run revf against a dataset and report its throughput."
+)
+
+parser.add_argument(
+	"--revf",
+	required = True,
+	help = "Path to the revf binary."
+)
+
+parser.add_argument(
+	"--dataset",
+	required = True,
+	help = "Dataset directory, as created by generate_dataset.py."
+)
+
+parser.add_argument(
+	"--runs",
+	required = False,
+	default = 2,
+	type = int,
+	help = "Number of runs per cache state. Use an even number to leave the content of the dataset unchanged."
+)
+
+parser.add_argument(
+	"--cache",
+	required = False,
+	default = "cold,warm",
+	help = "Comma separated list of page cache states to measure (cold, warm)."
+)
+
+parser.add_argument(
+	"--revf-args",
+	dest = "revf_args",
+	required = False,
+	default = "",
+	help = "Extra arguments passed to revf, in addition to -r."
+)
+
+parser.add_argument(
+	"--json",
+	required = False,
+	action = "store_true",
+	help = "Print the results as JSON."
+)
+
+arguments = parser.parse_args()
+
+tree = os.path.join(arguments.dataset, "tree")
+
+if not os.path.isdir(tree):
+	tree = arguments.dataset
+
+(files, total) = scan(tree)
+
+print("Dataset: %i files, %.1f MB" % (files, total / 1e6), file = sys.stderr)
+
+revf_arguments = ["-r"] + arguments.revf_args.split()
+
+results = []
+
+for cache in arguments.cache.split(","):
+	timings = []
+	peaks = []
+
+	for index in range(arguments.runs):
+		relink(tree)
+
+		if cache == "cold":
+			drop_caches(tree)
+		elif cache == "warm":
+			warm_caches(tree)
+		else:
+			print("fatal error: unknown cache state '%s'" % cache, file = sys.stderr)
+			sys.exit(1)
+
+		(elapsed, peak) = run(arguments.revf, revf_arguments, tree)
+
+		timings.append(elapsed)
+		peaks.append(peak)
+
+		print("%s run %i: %.3f s" % (cache, index + 1, elapsed), file = sys.stderr)
+
+	elapsed = statistics.median(timings)
+
+	results.append({
+		"cache": cache,
+		"runs": arguments.runs,
+		"seconds": elapsed,
+		"files_per_second": files / elapsed,
+		"megabytes_per_second": total / elapsed / 1e6,
+		"peak_rss": max(peaks)
+	})
+
+if arguments.json:
+	json.dump(results, sys.stdout, indent = 4)
+	print()
+else:
+	print("%-6s %10s %12s %10s %12s" % ("cache", "seconds", "files/s", "MB/s", "peak RSS MB"))
+
+	for result in results:
+		print("%-6s %10.3f %12.1f %10.1f %12.1f" % (
+			result["cache"],
+			result["seconds"],
+			result["files_per_second"],
+			result["megabytes_per_second"],
+			result["peak_rss"] / 1e6
+		))
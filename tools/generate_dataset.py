@@ -0,0 +1,398 @@
+#!/usr/bin/env python3
+
+"""
+Builds reproducible directory trees for benchmarking revf.
+
+The same seed and options always produce byte-identical trees. The tree is written
+to "<output>/tree", next to a "<output>/manifest.json" that describes it.
+
+It can also capture a file size histogram from an existing (production) tree, which
+can then be fed back with --histogram to replay the shape of a real workload.
+"""
+
+import argparse
+import json
+import os
+import random
+import sys
+
+# Files per directory when spreading many files around, similar to what most
+# applications do to keep directories listable
+FILES_PER_DIRECTORY = 1000
+
+# Granularity of the data written to large and sparse files
+BLOCK_SIZE = 1024 * 1024
+
+PRESETS = {
+	"small": {
+		"tiny_files": 20000,
+		"tiny_max_size": 4096,
+		"large_files": 2,
+		"large_size": 256 * 1024 * 1024,
+		"sparse_files": 2,
+		"sparse_size": 1024 * 1024 * 1024,
+		"sparse_extents": 16,
+		"depth": 64,
+		"hardlinks": 1000
+	},
+	"full": {
+		"tiny_files": 2000000,
+		"tiny_max_size": 4096,
+		"large_files": 3,
+		"large_size": 4 * 1024 * 1024 * 1024,
+		"sparse_files": 4,
+		"sparse_size": 64 * 1024 * 1024 * 1024,
+		"sparse_extents": 256,
+		"depth": 256,
+		"hardlinks": 100000
+	}
+}
+
+def parse_size(value):
+
+	suffixes = {
+		"k": 1024,
+		"m": 1024 ** 2,
+		"g": 1024 ** 3,
+		"t": 1024 ** 4
+	}
+
+	value = value.strip().lower()
+
+	if value and value[-1] in suffixes:
+		return int(value[:-1]) * suffixes[value[-1]]
+
+	return int(value)
+
+def spread(root, index):
+	"""
+	Returns the directory for the nth file of a set, creating it if needed.
+	"""
+
+	directory = os.path.join(root, "%04d" % (index // FILES_PER_DIRECTORY))
+
+	if index % FILES_PER_DIRECTORY == 0:
+		os.makedirs(directory, exist_ok = True)
+
+	return directory
+
+def write_random(file, rng, size):
+
+	while size > 0:
+		length = min(size, BLOCK_SIZE)
+		file.write(rng.randbytes(length))
+		size -= length
+
+def generate_tiny(root, rng, count, max_size):
+
+	directory = os.path.join(root, "tiny")
+
+	total = 0
+
+	for index in range(count):
+		size = rng.randint(0, max_size)
+
+		with open(os.path.join(spread(directory, index), "%08d" % index), "wb") as file:
+			file.write(rng.randbytes(size))
+
+		total += size
+
+	return (count, total)
+
+def generate_large(root, rng, count, size):
+
+	directory = os.path.join(root, "large")
+	os.makedirs(directory, exist_ok = True)
+
+	for index in range(count):
+		with open(os.path.join(directory, "large-%02d.bin" % index), "wb") as file:
+			write_random(file, rng, size)
+
+	return (count, count * size)
+
+def generate_sparse(root, rng, count, size, extents):
+	"""
+	Creates files of the given apparent size with a few data extents scattered
+	between holes. The first and last blocks always hold data, which exercises the
+	unaligned head and tail of the mirrored layout.
+	"""
+
+	directory = os.path.join(root, "sparse")
+	os.makedirs(directory, exist_ok = True)
+
+	allocated = 0
+
+	for index in range(count):
+		blocks = max(size // BLOCK_SIZE, 1)
+		offsets = sorted(set([0, blocks - 1] + [rng.randrange(blocks) for _ in range(extents)]))
+
+		with open(os.path.join(directory, "sparse-%02d.img" % index), "wb") as file:
+			for block in offsets:
+				start = block * BLOCK_SIZE
+				length = max(min(BLOCK_SIZE, size - start) - rng.randrange(512), 1)
+
+				# Keep the data flush with the end of the file in the last block
+				if block == blocks - 1:
+					start = size - length
+
+				file.seek(start)
+				file.write(rng.randbytes(length))
+
+				allocated += length
+
+			file.truncate(size)
+
+	return (count, allocated)
+
+def generate_deep(root, rng, depth):
+
+	directory = os.path.join(root, "deep")
+
+	files = 0
+	total = 0
+
+	for level in range(depth):
+		directory = os.path.join(directory, "d%03d" % level)
+		os.makedirs(directory, exist_ok = True)
+
+		size = rng.randint(0, 8192)
+
+		with open(os.path.join(directory, "file"), "wb") as file:
+			file.write(rng.randbytes(size))
+
+		files += 1
+		total += size
+
+	return (files, total)
+
+def generate_hardlinks(root, rng, count):
+	"""
+	Creates count files, each one with a second hard link in another directory.
+	"""
+
+	primary = os.path.join(root, "hardlinks", "primary")
+	secondary = os.path.join(root, "hardlinks", "secondary")
+
+	total = 0
+
+	for index in range(count):
+		size = rng.randint(0, 65536)
+
+		source = os.path.join(spread(primary, index), "%08d" % index)
+
+		with open(source, "wb") as file:
+			file.write(rng.randbytes(size))
+
+		os.link(source, os.path.join(spread(secondary, index), "%08d" % index))
+
+		total += size
+
+	return (count * 2, total * 2)
+
+def generate_histogram(root, rng, histogram):
+	"""
+	Creates files following a histogram of (size, count) buckets. Sizes within a
+	bucket are drawn uniformly between the previous bucket bound and this one.
+	"""
+
+	directory = os.path.join(root, "replay")
+
+	buckets = []
+
+	with open(histogram, "r") as file:
+		for line in file:
+			line = line.strip()
+
+			if not line or line.startswith("#") or line.startswith("size"):
+				continue
+
+			(size, count) = line.split(",")[:2]
+			buckets.append((int(size), int(count)))
+
+	buckets.sort()
+
+	index = 0
+	total = 0
+	lower = 0
+
+	for (upper, count) in buckets:
+		for _ in range(count):
+			size = rng.randint(lower, upper)
+
+			with open(os.path.join(spread(directory, index), "%08d" % index), "wb") as file:
+				write_random(file, rng, size)
+
+			index += 1
+			total += size
+
+		lower = upper + 1
+
+	return (index, total)
+
+def histogram(directory, output):
+	"""
+	Prints a power-of-two file size histogram of an existing tree as CSV.
+	"""
+
+	buckets = {}
+
+	for (root, _, files) in os.walk(directory):
+		for name in files:
+			path = os.path.join(root, name)
+
+			if not os.path.isfile(path) or os.path.islink(path):
+				continue
+
+			size = os.path.getsize(path)
+			upper = 1 << max(size - 1, 0).bit_length()
+
+			buckets[upper] = buckets.get(upper, 0) + 1
+
+	output.write("size,count\n")
+
+	for upper in sorted(buckets):
+		output.write("%i,%i\n" % (upper, buckets[upper]))
+
+def generate(arguments):
+
+	options = dict(PRESETS[arguments.preset])
+
+	for key in options:
+		value = getattr(arguments, key, None)
+
+		if value is not None:
+			options[key] = value
+
+	tree = os.path.join(arguments.output, "tree")
+
+	if os.path.exists(tree):
+		print("fatal error: '%s' already exists" % tree, file = sys.stderr)
+		sys.exit(1)
+
+	os.makedirs(tree)
+
+	rng = random.Random(arguments.seed)
+
+	manifest = {
+		"seed": arguments.seed,
+		"preset": arguments.preset,
+		"options": options,
+		"sets": {}
+	}
+
+	sets = arguments.sets.split(",")
+
+	for name in sets:
+		print("Generating %s files" % name, file = sys.stderr)
+
+		# Each set gets its own generator, so that enabling or disabling one set does
+		# not change the contents of the others
+		set_rng = random.Random("%s-%s" % (arguments.seed, name))
+
+		if name == "tiny":
+			result = generate_tiny(tree, set_rng, options["tiny_files"], options["tiny_max_size"])
+		elif name == "large":
+			result = generate_large(tree, set_rng, options["large_files"], options["large_size"])
+		elif name == "sparse":
+			result = generate_sparse(tree, set_rng, options["sparse_files"], options["sparse_size"], options["sparse_extents"])
+		elif name == "deep":
+			result = generate_deep(tree, set_rng, options["depth"])
+		elif name == "hardlinks":
+			result = generate_hardlinks(tree, set_rng, options["hardlinks"])
+		else:
+			print("fatal error: unknown set '%s'" % name, file = sys.stderr)
+			sys.exit(1)
+
+		manifest["sets"][name] = {
+			"files": result[0],
+			"bytes": result[1]
+		}
+
+	if arguments.histogram is not None:
+		print("Generating files from histogram", file = sys.stderr)
+
+		result = generate_histogram(tree, rng, arguments.histogram)
+
+		manifest["sets"]["replay"] = {
+			"files": result[0],
+			"bytes": result[1]
+		}
+
+	with open(os.path.join(arguments.output, "manifest.json"), "w") as file:
+		json.dump(manifest, file, indent = 4)
+
+parser = argparse.ArgumentParser(
+	description = "Build reproducible directory trees for benchmarking revf."
+)
+
+subparsers = parser.add_subparsers(
+	dest = "command",
+	required = True
+)
+
+generate_parser = subparsers.add_parser(
+	"generate",
+	help = "Generate a dataset."
+)
+
+generate_parser.add_argument(
+	"--output",
+	required = True,
+	help = "Directory to create the dataset in."
+)
+
+generate_parser.add_argument(
+	"--seed",
+	required = False,
+	default = 0,
+	type = int,
+	help = "Seed for the file sizes and contents."
+)
+
+generate_parser.add_argument(
+	"--preset",
+	required = False,
+	default = "small",
+	choices = sorted(PRESETS),
+	help = "Base set of sizes and counts."
+)
+
+generate_parser.add_argument(
+	"--sets",
+	required = False,
+	default = "tiny,large,sparse,deep,hardlinks",
+	help = "Comma separated list of file sets to generate."
+)
+
+generate_parser.add_argument(
+	"--histogram",
+	required = False,
+	help = "CSV of size,count buckets (as printed by the histogram command) to replay."
+)
+
+generate_parser.add_argument("--tiny-files", dest = "tiny_files", type = int)
+generate_parser.add_argument("--tiny-max-size", dest = "tiny_max_size", type = parse_size)
+generate_parser.add_argument("--large-files", dest = "large_files", type = int)
+generate_parser.add_argument("--large-size", dest = "large_size", type = parse_size)
+generate_parser.add_argument("--sparse-files", dest = "sparse_files", type = int)
+generate_parser.add_argument("--sparse-size", dest = "sparse_size", type = parse_size)
+generate_parser.add_argument("--sparse-extents", dest = "sparse_extents", type = int)
+generate_parser.add_argument("--depth", type = int)
+generate_parser.add_argument("--hardlinks", type = int)
+
+histogram_parser = subparsers.add_parser(
+	"histogram",
+	help = "Print the file size histogram of an existing tree."
+)
+
+histogram_parser.add_argument(
+	"directory",
+	help = "Directory to scan."
+)
+
+arguments = parser.parse_args()
+
+if arguments.command == "generate":
+	generate(arguments)
+else:
+	histogram(arguments.directory, sys.stdout)
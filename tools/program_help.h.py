@@ -32,7 +32,124 @@ parser.add_argument(
 	"--recursive",
 	required = False,
 	action = "store_true",
-	help = "Recurse down into directories."
+	help = "Recurse down into directories. Symbolic links below the directories given are not followed, and a directory reached more than once, through a bind mount or by being given twice, is only walked the first time."
+)
+
+parser.add_argument(
+	"-x",
+	"--one-file-system",
+	required = False,
+	action = "store_true",
+	help = "With -r, skip directories on other filesystems than the directory given, such as mount points."
+)
+
+parser.add_argument(
+	"-c",
+	"--stdout",
+	required = False,
+	action = "store_true",
+	help = "Write the reversed content of files to standard output, leaving the files themselves untouched."
+)
+
+parser.add_argument(
+	"-o",
+	"--output",
+	required = False,
+	metavar = "DIR",
+	help = "Write reversed files to DIR instead of replacing them, leaving the files themselves untouched. With -r, the content of each directory is recreated under DIR."
+)
+
+parser.add_argument(
+	"-i",
+	"--in-place",
+	required = False,
+	action = "store_true",
+	help = "Reverse files in place, without writing a temporary copy of them. A file with several hard links is only reversed once, through the first link met; the other links are reported and skipped."
+)
+
+parser.add_argument(
+	"--journal",
+	required = False,
+	action = "store_true",
+	help = "With --in-place, keep an undo journal next to each file so that an interrupted run can be resumed."
+)
+
+parser.add_argument(
+	"-j",
+	"--jobs",
+	required = False,
+	type = int,
+	metavar = "N",
+	help = "Number of threads to use (default: the number of CPUs revf may run on, as limited by its CPU affinity and cgroup CPU quota). With -r, N threads walk directories and reverse their files at the same time, taking work from each other whenever they run out. Each file is then reversed by a single thread, with the same engine and settings as with -j 1; --io-engine=uring, --stdout and --order=physical always walk on a single thread. Otherwise, when -j is given and neither --io-engine nor a measured profile chose an engine, files of 64 MiB and more are split into N segments, reversed at the same time."
+)
+
+parser.add_argument(
+	"--direct",
+	required = False,
+	action = "store_true",
+	help = "Bypass the page cache with direct I/O, so that reversing huge files does not evict everything else from memory. Files on filesystems without direct I/O support are reversed normally."
+)
+
+parser.add_argument(
+	"--durability",
+	required = False,
+	metavar = "MODE",
+	help = "How reversed files are made to survive a crash or power loss: none, batch or file (default: none). none leaves it all to the operating system. With batch, the data of every 64 files is synced at once, with a single flush of their filesystem, and only then do they replace the originals, so that a crash never leaves an empty or partial file behind. Until then, the originals stay in place: a file given more than once is reversed from its original each time, and an interrupted run leaves up to 63 files unreversed. file syncs each file and its directory on its own, which is much slower with many small files. With --io-engine=uring, batch and file both sync each file before it replaces its original, with the flushes of many files in flight at once instead of batches; file also syncs the directory afterwards."
+)
+
+parser.add_argument(
+	"--order",
+	required = False,
+	choices = ["directory", "physical"],
+	default = "directory",
+	metavar = "ORDER",
+	help = "Order in which the files of a directory tree are reversed with -r: directory or physical (default: directory). directory follows the order of the directory entries. physical collects up to 4096 files at a time and reverses them in the order their data is laid out on the device, as told by FIEMAP on Linux, or by their file IDs elsewhere, which avoids seeking back and forth on hard disks. It implies -j 1 for directory trees."
+)
+
+parser.add_argument(
+	"--io-engine",
+	required = False,
+	choices = ["auto", "stream", "mmap", "uring"],
+	default = "auto",
+	metavar = "ENGINE",
+	help = "Method used to read and write file contents: auto, stream, mmap or uring (default: auto). With auto, large regular files are reversed through memory mappings. uring reverses many files at once through io_uring on Linux, and falls back to auto where it is not available."
+)
+
+parser.add_argument(
+	"--readahead",
+	required = False,
+	default = "8M",
+	metavar = "SIZE",
+	help = "Amount of data to request ahead of the backward reads of the stream engine, with an optional K, M or G suffix (default: 8M). 0 leaves readahead to the operating system."
+)
+
+parser.add_argument(
+	"--chunk-size",
+	required = False,
+	metavar = "SIZE",
+	help = "Size of the blocks read and written by the stream engine, with an optional K, M or G suffix. By default, it is measured for each device along with the best engine, see --no-autotune."
+)
+
+parser.add_argument(
+	"--no-autotune",
+	required = False,
+	action = "store_true",
+	help = "Do not measure devices. Otherwise, the first file of 40 MiB or more reversed on a device is used to find the chunk size and engine that work best for it, and the results are saved to revf.profile in the cache directory of the user for later runs. Settings given on the command line always take precedence."
+)
+
+parser.add_argument(
+	"--stdin",
+	required = False,
+	action = "store_true",
+	help = "Write the reversed content of standard input to standard output. A lone - does the same."
+)
+
+parser.add_argument(
+	"--memory-limit",
+	required = False,
+	default = "256M",
+	metavar = "SIZE",
+	help = "Amount of memory used to buffer standard input with --stdin, with an optional K, M or G suffix (default: 256M). Any input beyond that is kept in a temporary file."
 )
 
 os.environ["LINES"] = "1000"